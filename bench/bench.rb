@@ -0,0 +1,105 @@
+# Benchmarks the exported functions on a synthetic loan tape: bullet and amortizing, monthly and quarterly, 1 to 40
+# years, fixed and floating. Run with `rake bench` (LOANS=n and SEED=n to change the tape), which builds the extension
+# first; bench/bench_solver.c times the same kernels without Ruby in the way.
+require 'c_helper'
+
+LOANS = Integer(ENV.fetch('LOANS', 2000))
+SEED  = Integer(ENV.fetch('SEED', 20190405))
+
+RES       = 1e-8
+MAX_TRIES = 100
+YEAR      = 360.0
+
+Loan = Struct.new(:cfs, :dates, :libor, :target_px, :packed)
+
+def make_loan(rng)
+  periods_per_year = rng.rand < 0.5 ? 12 : 4
+  n = periods_per_year * (1 + rng.rand(40))
+  amortizing = rng.rand < 0.5
+  floating = rng.rand < 0.5
+  coupon = floating ? 0.01 + 0.04 * rng.rand : 0.03 + 0.07 * rng.rand
+  balance = 100.0
+  payment = 0.0
+  cfs, dates, libor = [], [], []
+
+  n.times do |t|
+    dates << (t + 1) * 365.0 / periods_per_year
+    libor << (floating ? 0.02 + 0.03 * dates[t] / (40.0 * 365.0) : 0.0)
+    rate = (libor[t] + coupon) / periods_per_year
+    interest = balance * rate
+    principal =
+      if !amortizing
+        t == n - 1 ? balance : 0.0
+      else
+        payment = balance * rate / (1.0 - (1.0 + rate)**-(n - t)) if t.zero? || floating
+        t == n - 1 ? balance : payment - interest
+      end
+    balance -= principal
+    cfs << interest + principal
+  end
+
+  spread = (floating ? 0.005 : 0.02) + 0.06 * rng.rand
+  target_px = CHelper.compute_pv_grid(cfs, dates, libor, [spread], false, 0.0, YEAR)[0]
+  Loan.new(cfs, dates, libor, target_px, [cfs.pack('d*'), dates.pack('d*'), libor.pack('d*')])
+end
+
+def max_rss_mb
+  File.read('/proc/self/status')[/VmHWM:\s+(\d+)/, 1].to_i / 1024.0
+rescue SystemCallError
+  Float::NAN
+end
+
+# times the block, which makes `solves` solves over `cash_flows` cash flows in total
+def report(name, solves, cash_flows)
+  GC.start
+  CHelper.reset_stats
+  allocated = GC.stat(:total_allocated_objects)
+  start = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+  yield
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond) - start
+  allocated = GC.stat(:total_allocated_objects) - allocated
+  stats = CHelper.stats
+  iterations = stats[:iterations].each_with_index.sum { |count, n| count * n }.to_f / stats[:solves] if stats[:solves] > 0
+  printf("%-26s %12.0f %10.2f %12.2f %8s %10.1f%%\n", name, solves / (elapsed / 1e9), elapsed.to_f / cash_flows, allocated.to_f / solves,
+    iterations ? format('%.2f', iterations) : '-', 100.0 * stats[:marshal_ns] / elapsed)
+end
+
+rng = Random.new(SEED)
+loans = Array.new(LOANS) { make_loan(rng) }
+total_cfs = loans.sum { |l| l.cfs.size }
+printf("%d loans, %d cash flows (%.1f per loan)\n", LOANS, total_cfs, total_cfs.to_f / LOANS)
+printf("%-26s %12s %10s %12s %8s %11s\n", '', 'solves/sec', 'ns/cf', 'objs/solve', 'iters', 'marshal')
+
+%i[secant newton brent].each do |method|
+  report("backsolve_cf #{method}", LOANS, total_cfs) do
+    loans.each { |l| CHelper.backsolve_cf(l.cfs, l.dates, l.libor, l.cfs.size, l.target_px, RES, MAX_TRIES, false, 0.0, YEAR, method: method) }
+  end
+end
+
+report('backsolve_cf_packed', LOANS, total_cfs) do
+  loans.each { |l| CHelper.backsolve_cf_packed(*l.packed, l.target_px, RES, MAX_TRIES, false, 0.0, YEAR) }
+end
+
+streams = loans.map { |l| CHelper::CashFlowStream.new(l.packed[0], l.packed[1]) }
+report('CashFlowStream#solve_spread', LOANS, total_cfs) do
+  loans.each_with_index { |l, i| streams[i].solve_spread(l.packed[2], l.target_px, RES, MAX_TRIES, false, 0.0, YEAR) }
+end
+
+report('backsolve_cf_batch', LOANS, total_cfs) do
+  CHelper.backsolve_cf_batch(loans.map(&:cfs), loans.map(&:dates), loans.map(&:libor), loans.map(&:target_px), RES, MAX_TRIES,
+    false, Array.new(LOANS, 0.0), YEAR)
+end
+
+CHelper.clear_solution_cache
+loans.each_with_index { |l, i| CHelper.backsolve_cf_packed(*l.packed, l.target_px, RES, MAX_TRIES, false, 0.0, YEAR, loan_id: i) }
+report('backsolve_cf_packed warm', LOANS, total_cfs) do
+  loans.each_with_index { |l, i| CHelper.backsolve_cf_packed(*l.packed, l.target_px * 1.001, RES, MAX_TRIES, false, 0.0, YEAR, loan_id: i) }
+end
+CHelper.clear_solution_cache
+
+spreads = Array.new(100) { |j| 0.0005 * j }
+report('compute_pv_grid (100)', LOANS * spreads.size, total_cfs * spreads.size) do
+  loans.each { |l| CHelper.compute_pv_grid(*l.packed, spreads, false, 0.0, YEAR) }
+end
+
+printf("peak RSS %.1f MB\n", max_rss_mb)
\ No newline at end of file
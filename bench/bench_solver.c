@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "c_helper.h"
+
+/* bench_solver.c
+ * standalone driver for the kernels in solver.c, with no Ruby in the way: generates a synthetic loan tape, then times
+ * _compute_pv(), _backsolve_cf() and _backsolve_irr() over it with each solver method
+ *
+ * build and run with `rake bench:c`, or by hand:
+ *   cc -O3 -fno-fast-math -ffp-contract=off -Iext/c_helper bench/bench_solver.c ext/c_helper/solver.c ext/c_helper/day_count.c -lm -o bench_solver
+ *   ./bench_solver [num_loans] [seed]
+ */
+
+#define DEFAULT_NUM_LOANS 2000
+#define PV_PASSES         20
+
+typedef struct {
+  double *cfs, *dates, *libor;
+  long num_cfs;
+  double target_px;             // PV at spread
+  double spread;                // what the backsolve should find
+  double *irr_cfs, *irr_dates;  // -target_px on day 1, then the loan's cash flows
+} loan;
+
+
+/* _next_random()
+ * xorshift64*, so a given seed always produces the same tape on every platform
+ */
+static uint64_t rng_state;
+
+static double _next_random(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;  // [0, 1)
+}
+
+
+/* _make_loan()
+ * builds one loan of the tape: bullet or level-pay amortizing, monthly or quarterly, 1 to 40 years, fixed (libor all
+ * 0.0, so the backsolve is a yield) or floating off an upward-sloping forward curve
+ */
+static void _make_loan(loan *l) {
+  int periods_per_year = _next_random() < 0.5 ? 12 : 4;
+  int years = 1 + (int)(_next_random() * 40);
+  int amortizing = _next_random() < 0.5;
+  int floating = _next_random() < 0.5;
+  double coupon = floating ? 0.01 + 0.04 * _next_random() : 0.03 + 0.07 * _next_random();
+  double balance = 100.0, rate, payment = 0.0, interest, principal;
+  long t, n = (long)periods_per_year * years;
+
+  l->num_cfs   = n;
+  l->cfs       = malloc(n * sizeof(double));
+  l->dates     = malloc(n * sizeof(double));
+  l->libor     = malloc(n * sizeof(double));
+  l->irr_cfs   = malloc((n + 1) * sizeof(double));
+  l->irr_dates = malloc((n + 1) * sizeof(double));
+  if (l->cfs == NULL || l->dates == NULL || l->libor == NULL || l->irr_cfs == NULL || l->irr_dates == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  for (t = 0; t < n; t++) {
+    l->dates[t] = (double)(t + 1) * 365.0 / periods_per_year;
+    l->libor[t] = floating ? 0.02 + 0.03 * l->dates[t] / (40.0 * 365.0) : 0.0;
+    rate = (l->libor[t] + coupon) / periods_per_year;
+
+    interest = balance * rate;
+    if (!amortizing)
+      principal = t == n - 1 ? balance : 0.0;
+    else {
+      if (t == 0 || floating)  // level pay over the remaining periods, re-fixed each period when floating
+        payment = balance * rate / (1.0 - pow(1.0 + rate, -(double)(n - t)));
+      principal = t == n - 1 ? balance : payment - interest;
+    }
+    balance -= principal;
+    l->cfs[t] = interest + principal;
+  }
+
+  l->spread    = (floating ? 0.005 : 0.02) + 0.06 * _next_random();
+  l->target_px = _compute_pv(l->cfs, l->dates, l->libor, n, 0, 0.0, 360.0, l->spread);
+
+  l->irr_cfs[0]   = -l->target_px;
+  l->irr_dates[0] = 1.0;
+  for (t = 0; t < n; t++) {
+    l->irr_cfs[t + 1]   = l->cfs[t];
+    l->irr_dates[t + 1] = l->dates[t] + 1.0;
+  }
+}
+
+
+static double _now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/* _report()
+ * prints one line of results; iterations are per solve, failures are anything that came back as a sentinel
+ */
+static void _report(const char *name, long solves, long total_cfs, double elapsed_ns, long iterations, long max_iterations, long failures) {
+  printf("%-22s %12.0f %10.2f %10.2f %8ld %8ld\n", name, solves / (elapsed_ns / 1e9), elapsed_ns / total_cfs,
+    solves > 0 ? (double)iterations / solves : 0.0, max_iterations, failures);
+}
+
+
+static void _bench_solver(const char *name, loan *loans, long num_loans, long total_cfs, int method, int irr) {
+  solver_opts opts = { .method = method, .guess = 0.06, .res = 1e-8, .max_tries = 100 };
+  long i, iterations = 0, max_iterations = 0, failures = 0;
+  double result, start = _now_ns();
+
+  for (i = 0; i < num_loans; i++) {
+    if (irr)
+      result = _backsolve_irr(loans[i].irr_cfs, loans[i].irr_dates, loans[i].num_cfs + 1, 0, 0.0, &opts);
+    else
+      result = _backsolve_cf(loans[i].cfs, loans[i].dates, loans[i].libor, loans[i].num_cfs, loans[i].target_px, 0, 0.0, 360.0, &opts);
+
+    if (result <= CH_NO_MEMORY && result >= CH_NO_SENSITIVITY)
+      failures++;
+    iterations += opts.iterations;
+    if (opts.iterations > max_iterations)
+      max_iterations = opts.iterations;
+  }
+
+  // ns/cf is per cash flow per solve, so it grows with the iteration count
+  _report(name, num_loans, irr ? total_cfs + num_loans : total_cfs, _now_ns() - start, iterations, max_iterations, failures);
+}
+
+
+int main(int argc, char **argv) {
+  long num_loans = argc > 1 ? atol(argv[1]) : DEFAULT_NUM_LOANS;
+  long i, pass, total_cfs = 0;
+  double start, sink = 0.0;
+  struct rusage usage;
+
+  rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 20190405;
+  if (num_loans < 1 || rng_state == 0) {
+    fprintf(stderr, "usage: %s [num_loans > 0] [seed > 0]\n", argv[0]);
+    return 1;
+  }
+
+  loan *loans = malloc(num_loans * sizeof(loan));
+  if (loans == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < num_loans; i++) {
+    _make_loan(&loans[i]);
+    total_cfs += loans[i].num_cfs;
+  }
+
+  printf("%ld loans, %ld cash flows (%.1f per loan), %.1f MB of inputs\n", num_loans, total_cfs, (double)total_cfs / num_loans,
+    (total_cfs * 5.0 + num_loans * 2.0) * sizeof(double) / 1e6);
+  printf("%-22s %12s %10s %10s %8s %8s\n", "", "solves/sec", "ns/cf", "iters", "max", "failed");
+
+  start = _now_ns();
+  for (pass = 0; pass < PV_PASSES; pass++)
+    for (i = 0; i < num_loans; i++)
+      sink += _compute_pv(loans[i].cfs, loans[i].dates, loans[i].libor, loans[i].num_cfs, 0, 0.0, 360.0, loans[i].spread);
+  _report("_compute_pv", num_loans * PV_PASSES, total_cfs * PV_PASSES, _now_ns() - start, num_loans * PV_PASSES, 1, 0);
+
+  _bench_solver("backsolve_cf secant",  loans, num_loans, total_cfs, CH_SECANT, 0);
+  _bench_solver("backsolve_cf newton",  loans, num_loans, total_cfs, CH_NEWTON, 0);
+  _bench_solver("backsolve_cf brent",   loans, num_loans, total_cfs, CH_BRENT,  0);
+  _bench_solver("backsolve_irr secant", loans, num_loans, total_cfs, CH_SECANT, 1);
+  _bench_solver("backsolve_irr newton", loans, num_loans, total_cfs, CH_NEWTON, 1);
+  _bench_solver("backsolve_irr brent",  loans, num_loans, total_cfs, CH_BRENT,  1);
+
+  getrusage(RUSAGE_SELF, &usage);
+  printf("peak RSS %.1f MB (PV checksum %.6g)\n", usage.ru_maxrss / 1024.0, sink);
+
+  for (i = 0; i < num_loans; i++) {
+    free(loans[i].cfs); free(loans[i].dates); free(loans[i].libor); free(loans[i].irr_cfs); free(loans[i].irr_dates);
+  }
+  free(loans);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include <stddef.h>
+#include <math.h>
+#include "c_helper.h"
+
+/* amortization.c
+ * the kernels that turn a loan's terms into its cash flows, and then run prepayments and defaults through them, so a
+ * tape can be generated natively and handed straight to the solvers; like solver.c, nothing in here touches the Ruby
+ * API
+ */
+
+
+
+/* _payment_dates()
+ * internal function that lays out num_periods payment dates, first_date days out and then every 365 / frequency days,
+ * in the same days as the dates the solvers take
+ */
+void _payment_dates(double first_date, long frequency, long num_periods, double *dates) {
+  double period_days = 365.0 / frequency;
+  long t;
+
+  for (t = 0; t < num_periods; t++)
+    dates[t] = first_date + t * period_days;
+}
+
+
+/* _amortize()
+ * internal function that builds the schedule for terms: the balance at the start of each period, the interest and
+ * principal paid at its end, and cfs, their sum, which is what _compute_pv() and the solvers take
+ *
+ * interest accrues at the period's rate (coupon, plus libor[t] for a floating loan) over 1 / frequency of a year. No
+ * principal is paid during the io_periods; after them
+ *  - CH_LEVEL_PAY pays the annuity that retires the balance over the remaining periods, re-fixed every period, so a
+ *    floating rate (or a balance that has been prepaid) just re-amortizes over what's left
+ *  - CH_STRAIGHT_LINE pays the balance after the IO periods down in equal installments
+ *  - CH_BULLET pays nothing until maturity
+ *  - CH_CUSTOM_AMORT pays amort_table[t], capped at the balance outstanding
+ * and whatever is left is paid at maturity
+ *
+ * each output needs room for num_periods values
+ */
+void _amortize(ch_loan_terms *terms, double *balances, double *interest, double *principal, double *cfs) {
+  double balance = terms->balance, rate, installment = 0.0;
+  long t, n = terms->num_periods, remaining;
+
+  if (terms->amortization == CH_STRAIGHT_LINE && n > terms->io_periods)
+    installment = balance / (n - terms->io_periods);
+
+  for (t = 0; t < n; t++) {
+    rate = (terms->libor != NULL ? terms->libor[t] + terms->coupon : terms->coupon) / terms->frequency;
+    remaining = n - t;
+
+    balances[t] = balance;
+    interest[t] = balance * rate;
+
+    if (t == n - 1)
+      principal[t] = balance;
+    else if (t < terms->io_periods)
+      principal[t] = 0.0;
+    else {
+      switch (terms->amortization) {
+        case CH_LEVEL_PAY:
+          principal[t] = rate == 0.0 ? balance / remaining : balance * rate / (1.0 - pow(1.0 + rate, -(double)remaining)) - interest[t];
+          break;
+        case CH_STRAIGHT_LINE:
+          principal[t] = installment;
+          break;
+        case CH_CUSTOM_AMORT:
+          principal[t] = terms->amort_table[t];
+          break;
+        default:  // CH_BULLET
+          principal[t] = 0.0;
+      }
+      if (principal[t] > balance)
+        principal[t] = balance;
+    }
+
+    balance -= principal[t];
+    cfs[t] = interest[t] + principal[t];
+  }
+}
+
+
+/* _smm_vector()
+ * internal function that turns a prepayment speed into the single monthly mortality (the fraction of the balance
+ * prepaid, strictly per period rather than per month) for each of num_periods periods:
+ *  - CH_CPR: speed is a constant annual rate, e.g. 0.06 for 6 CPR
+ *  - CH_PSA: speed is a percentage of the PSA benchmark, which ramps the CPR from 0.2% in the first month of the loan's
+ *    life by 0.2% a month to 6% at month 30 and holds it there; age is how many months old the loan is at the start
+ *    of the first period
+ * an annual rate is converted to one for 1 / frequency of a year by compounding, 1 - (1 - CPR)^(1 / frequency)
+ */
+void _smm_vector(int model, double speed, long frequency, long age, long num_periods, double *smm) {
+  double cpr = speed, months;
+  long t;
+
+  for (t = 0; t < num_periods; t++) {
+    if (model == CH_PSA) {
+      months = age + (t + 1) * 12.0 / frequency;  // the loan's age at the end of the period
+      cpr = 0.06 * (months < 30.0 ? months : 30.0) / 30.0 * speed / 100.0;
+    }
+    smm[t] = cpr >= 1.0 ? 1.0 : 1.0 - pow(1.0 - cpr, 1.0 / frequency);
+  }
+}
+
+
+/* _periodic_rates()
+ * internal function that converts annual rates of attrition (CPRs, CDRs) to rates per period of 1 / frequency of a
+ * year, as _smm_vector() does
+ */
+void _periodic_rates(double *annual_rates, long frequency, long num_periods, double *rates) {
+  long t;
+
+  for (t = 0; t < num_periods; t++)
+    rates[t] = annual_rates[t] >= 1.0 ? 1.0 : 1.0 - pow(1.0 - annual_rates[t], 1.0 / frequency);
+}
+
+
+/* _apply_prepayments()
+ * internal function that runs prepayments at smm[t] in period t through a scheduled (prepayment-free) schedule from
+ * _amortize(), in place; cfs stay interest plus principal, with the prepaid principal included in principal
+ *
+ * the loan is treated as a pool: each period a fraction smm[t] of what's left after the scheduled principal is
+ * prepaid, and everything after it (balance, interest and scheduled principal alike) shrinks pro rata with the
+ * balance that survives. For a level-pay loan that's exactly re-amortizing the smaller balance over the remaining term
+ */
+void _apply_prepayments(double *smm, long num_periods, double *balances, double *interest, double *principal, double *cfs) {
+  double survival = 1.0, scheduled;
+  long t;
+
+  for (t = 0; t < num_periods; t++) {
+    balances[t] *= survival;
+    interest[t] *= survival;
+    scheduled = principal[t] * survival;
+    principal[t] = scheduled + smm[t] * (balances[t] - scheduled);
+    cfs[t] = interest[t] + principal[t];
+    survival *= 1.0 - smm[t];
+  }
+}
+
+
+/* _apply_defaults()
+ * internal function that runs defaults through a schedule in place: in period t, a fraction mdr[t] (the monthly
+ * default rate, again strictly per period) of the performing balance defaults and pays neither its interest nor its
+ * principal; lag periods later, severity of the defaulted balance is written off into losses and the rest comes back
+ * as a recovery, added to that period's cf. A recovery that would land after maturity is taken in the last period
+ *
+ * as with _apply_prepayments(), the loan is treated as a pool and everything the defaulted balance would have paid
+ * later goes with it, so balances, interest and principal end up as the performing pool's, with balances[t] what's
+ * still performing in period t once its defaults are out. Prepayments have to be run first, since defaults already
+ * taken can't be scaled back by a later prepayment; recoveries and losses accumulate if defaults are run more than once
+ */
+void _apply_defaults(double *mdr, long num_periods, double severity, long lag, double *balances, double *interest, double *principal, double *recoveries, double *losses, double *cfs) {
+  double survival = 1.0, defaulted;
+  long t, r;
+
+  for (t = 0; t < num_periods; t++) {
+    defaulted = balances[t] * survival * mdr[t];
+    balances[t]  *= survival * (1.0 - mdr[t]);
+    interest[t]  *= survival * (1.0 - mdr[t]);
+    principal[t] *= survival * (1.0 - mdr[t]);
+
+    r = t + lag < num_periods ? t + lag : num_periods - 1;
+    recoveries[r] += defaulted * (1.0 - severity);
+    losses[r]     += defaulted * severity;
+
+    survival *= 1.0 - mdr[t];
+  }
+
+  for (t = 0; t < num_periods; t++)
+    cfs[t] = interest[t] + principal[t] + recoveries[t];
+}
\ No newline at end of file
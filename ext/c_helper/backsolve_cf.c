@@ -1,162 +1,313 @@
 #include <stdio.h>
-#include <math.h>  // for pow() function in IRR calculation
 #include <ruby.h>
+#include <ruby/thread.h>  // for rb_thread_call_without_gvl()
+#include "c_helper.h"
 
-#define ABS(x) (((x)<0.0) ? (-(x)) : (x))
 
-/* TODO:
- * - Refactor code so that we're not duplicating Newton-Raphson algorithm between the price backsolve and IRR
- */
 
+/* _status_of()
+ * internal function that maps a value returned by _backsolve_cf() to the status code reported to Ruby: 0 for a real
+ * spread or yield, otherwise the sentinel itself as an integer
+ */
+int _status_of(double result) {
+  if (result == CH_NO_SENSITIVITY || result == CH_FAILED_TO_CONVERGE || result == CH_NO_CASH_FLOWS || result == CH_INVALID_INPUT ||
+      result == CH_NO_BRACKET || result == CH_NO_MEMORY)
+    return (int)result;
+  return 0;
+}
 
 
-/* _compute_pv()
- * internal function that computes the sum of the discounted present values of a stream of cash flows, using
- * the same logic as the Ruby code in the app
+/* _run_solve_job()
+ * internal function, called without the GVL, that solves the loans of a job from next_loan onwards; if the job gets
+ * interrupted it returns straight away, leaving next_loan on the loan it was working on. next_loan is the only record
+ * of progress: every loan below it is done, whatever its result (0.0 included)
  *
- * assumes that the arrays are properly allocated and are num_cfs in length
- * assumes that the discount rate and date calculations won't result in a denominator of 0
+ * if the job wants risk, each loan that converges gets its risk pass here too, while its cash flows are still hot
  */
-double _compute_pv(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double spread) {
-  double discount_rate, discount_factor = 1.0, prev_cumul_date = 0.0, cumul_pv = 0.0;
-  long t;
-  
-  if (num_cfs > 0) {
-    // loop through cash flows and discount
-    for (t = 0; t < num_cfs; t++) {
-      discount_rate = libor[t] + spread;
-      discount_factor /= (1.0 + discount_rate * (dates[t] - prev_cumul_date) / year_convention);
-      cumul_pv += cfs[t] * discount_factor;
-      prev_cumul_date = dates[t];
+static void *_run_solve_job(void *data) {
+  solve_job *job = (solve_job *)data;
+  double result;
+  long i, offset;
+
+  for (; job->next_loan < job->num_loans; job->next_loan++) {
+    i = job->next_loan;
+    offset = job->next_offset;
+
+    if (_status_of(job->results[i]) == 0) {  // not already failed by validation
+      if (job->guesses != NULL)
+        job->opts.guess = job->guesses[i];
+
+      if (job->libor != NULL)
+        result = _backsolve_cf(job->cfs + offset, job->dates + offset, job->libor + offset, job->num_cfs[i], job->target_px[i],
+          job->is_clean, job->accrued_interest[i], job->year_convention, &job->opts);
+      else
+        result = _backsolve_irr(job->cfs + offset, job->dates + offset, job->num_cfs[i],
+          job->is_clean, job->accrued_interest[i], &job->opts);
+
+      if (result == CH_INTERRUPTED)
+        return NULL;
+      job->results[i] = result;
+      _count_solve(&job->stats, result, &job->opts);
+
+      if (job->risk != NULL && _status_of(result) == 0) {
+        if (job->libor != NULL)
+          _compute_pv_risk(job->cfs + offset, job->dates + offset, job->libor + offset, job->num_cfs[i], job->year_convention, result, job->risk + 3 * i);
+        else
+          _compute_pv_for_irr_risk(job->cfs + offset, job->dates + offset, job->num_cfs[i], job->opts.day_count, result, job->risk + 3 * i);
+      }
     }
-  
-    if (is_clean)
-      cumul_pv -= accrued_interest;
-  
-    return cumul_pv;
-  } else { // no dates or cash flows to discount
-    return -997.0;
+
+    job->next_offset += job->num_cfs[i];
   }
+
+  return NULL;
 }
 
 
-/* _compute_pv_for_irr()
- * internal function that computes the sum of the discounted present values of a stream of cash flows, using
- * the same logic as the Ruby code in the app
- * 
- * Logic is Actual/365, annual compounded discount rates
- *
- * assumes that the arrays are properly allocated and are num_cfs in length
- * assumes that the discount rate and date calculations won't result in a denominator of 0
+/* _unblock_solve_job()
+ * unblocking function for rb_thread_call_without_gvl(); Ruby calls it from another thread when it needs our thread back
+ * (Thread#raise, Thread#kill, a signal, ...), so it can only flag the job and let the solver notice
  */
-double _compute_pv_for_irr(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, double irr) {
-  double discount_factor = 1.0, orig_date = 0.0, cumul_pv = 0.0;
-  double year_convention = 365.0;
-  long t;
-  
-  if (num_cfs > 0) {
-    orig_date = dates[0];
+static void _unblock_solve_job(void *data) {
+  ((solve_job *)data)->interrupted = 1;
+}
 
-    // loop through cash flows and discount
-    for (t = 0; t < num_cfs; t++) {
-      discount_factor = 1.0 / pow(1.0 + irr, (dates[t] - orig_date) / year_convention);
-      cumul_pv += cfs[t] * discount_factor;
-    }
-  
-    if (is_clean)
-      cumul_pv -= accrued_interest;
 
-    return cumul_pv;
-  } else { // no dates to discount
-    return -997.0;
-  }  
+static VALUE _run_solve_job_without_gvl(VALUE data) {
+  solve_job *job = (solve_job *)data;
+
+  while (job->next_loan < job->num_loans) {
+    job->interrupted = 0;
+    rb_thread_call_without_gvl(_run_solve_job, job, _unblock_solve_job, job);
+    // rb_thread_call_without_gvl() services the pending interrupt on the way out; if we're still here, it didn't raise
+    // (e.g. a trap handler ran), so carry on from the loan we were on
+  }
+
+  return Qnil;
 }
 
 
-/* _backsolve_cf()
- * internal function that applies a Newton-Raphson algorithm to find, for a given set of cash flows and a target NPV,
- * what discount *spread* (i.e. spread over libor) will get to that NPV.
+/* _solve_without_gvl()
+ * internal function that runs every loan in a job with the GVL released, so that other Ruby threads keep running (and
+ * other solves can use other cores) while we iterate
+ *
+ * servicing an interrupt can raise, so this returns the rb_protect() state instead of letting the exception through;
+ * the caller must free its buffers and then rb_jump_tag() if it is non-zero
  *
- * note that the NPV isn't a price (% of par), but rather a total dollar amount
+ * started_ns is when the caller was entered (from _clock_ns()), for the marshalling time in CHelper.stats
+ */
+int _solve_without_gvl(solve_job *job, long started_ns) {
+  int state = 0;
+  long solve_started_ns = _clock_ns();
+
+  job->next_loan = 0;
+  job->next_offset = 0;
+  job->opts.interrupted = &job->interrupted;
+  rb_protect(_run_solve_job_without_gvl, (VALUE)job, &state);
+
+  _record_stats(&job->stats, started_ns, solve_started_ns, _clock_ns());
+  return state;
+}
+
+
+/* _split_kwargs()
+ * internal function for exported functions that take a fixed list of positional arguments followed by keyword
+ * options: pops the options Hash off the end of argv (Qnil if there isn't one) and checks the positional count
+ */
+VALUE _split_kwargs(int *argc, VALUE *argv, int num_positional) {
+  VALUE kwargs = Qnil;
+
+  if (*argc > num_positional && RB_TYPE_P(argv[*argc - 1], T_HASH))
+    kwargs = argv[--(*argc)];
+  rb_check_arity(*argc, num_positional, num_positional);
+
+  return kwargs;
+}
+
+
+static VALUE spread_cache, irr_cache;  // loan_id => last converged spread / IRR
+
+
+/* _get_day_count()
+ * internal function that maps a day_count: option to its convention: :act_365f, :act_360, :thirty_360 or
+ * :act_act_isda (see day_count.c); nil is :act_365f
+ */
+int _get_day_count(VALUE day_count) {
+  if (NIL_P(day_count) || day_count == ID2SYM(rb_intern("act_365f")))
+    return CH_ACT_365F;
+  else if (day_count == ID2SYM(rb_intern("act_360")))
+    return CH_ACT_360;
+  else if (day_count == ID2SYM(rb_intern("thirty_360")))
+    return CH_30_360;
+  else if (day_count == ID2SYM(rb_intern("act_act_isda")))
+    return CH_ACT_ACT_ISDA;
+
+  rb_raise(rb_eArgError, "unknown day count %"PRIsVALUE" (expected :act_365f, :act_360, :thirty_360 or :act_act_isda)", day_count);
+  return CH_ACT_365F;
+}
+
+
+/* _get_solver_opts()
+ * internal function that builds the solver_opts for a solve from the res and max_tries arguments every solver takes,
+ * plus the keyword options:
+ *  - method: :secant (the default), :newton or :brent; see _solve()
+ *  - guess: where to start iterating, instead of 6%; e.g. yesterday's spread, which is usually a few bp away
+ *  - loan_id: any Hash key identifying the loan; unless there's a guess, the solve starts from the last value that
+ *    converged for that loan (see _remember_solution()). Not accepted when cache is NO_CACHE
+ *  - exception: false to get a CHelper::Result back instead of an exception when the solve fails; see _solver_result().
+ *    Also not accepted when cache is NO_CACHE, as the batch API never raises for a failed solve anyway
+ *  - risk: true to get a CHelper::Risk for the solution instead of a bare Float; see _risk_struct(). The batch API
+ *    handles this one itself
+ *  - day_count: for IRRs (cache is IRR_CACHE) only, the convention the dates are discounted over (see
+ *    _get_day_count()), instead of Actual/365; for anything but the Actual ones the dates are Julian Day Numbers
  *
- * if you have a fixed-rate loan, just pass a string of 0's in the libor array and it will return a yield instead of a spread
+ * cache says which solution cache loan_id refers to, SPREAD_CACHE or IRR_CACHE
  *
- * assumes that arrays are allocated and num_cfs in length
- * assumes that -999.0 and -998.0 will never be valid return values for spreads
+ * assumes that res and max_tries have already been through Check_Type
  */
-double _backsolve_cf(double *cfs, double *dates, double *libor, long num_cfs, double target_px, double res, long max_tries, char is_clean, double accrued_interest, double year_convention) {
-  double x_n_minus_1 = 0.06; // starting point of 6%
-  double x_n = x_n_minus_1 + 0.0025;
-  double x_n_plus_1;
-  double f_n_minus_1, f_n;
-  
-  f_n_minus_1 = target_px - _compute_pv(cfs, dates, libor, num_cfs, is_clean, accrued_interest, year_convention, x_n_minus_1);
-  f_n         = target_px - _compute_pv(cfs, dates, libor, num_cfs, is_clean, accrued_interest, year_convention, x_n        );
-  
-  long trials = 0;
-  
-  while (ABS(f_n) > res && trials < max_tries) {
-    if (f_n == f_n_minus_1) {
-      return -999.0;
-      // ERROR! Can't divide by 0
-    }
-    x_n_plus_1    = x_n - f_n * (x_n - x_n_minus_1) / (f_n - f_n_minus_1);
-    x_n_minus_1   = x_n;
-    x_n           = x_n_plus_1;
-
-    f_n_minus_1   = f_n;   // previous result
-    f_n           = target_px - _compute_pv(cfs, dates, libor, num_cfs, is_clean, accrued_interest, year_convention, x_n);
-    
-    trials++;
+solver_opts _get_solver_opts(VALUE res, VALUE max_tries, VALUE kwargs, int cache) {
+  solver_opts opts = { .method = CH_SECANT, .guess = 0.06, .res = NUM2DBL(res), .max_tries = NUM2LONG(max_tries) };
+  ID keys[6];
+  VALUE values[6];
+
+  if (NIL_P(kwargs))
+    return opts;
+
+  keys[0] = rb_intern("method");
+  keys[1] = rb_intern("guess");
+  keys[2] = rb_intern("loan_id");
+  keys[3] = rb_intern("exception");
+  keys[4] = rb_intern("risk");
+  keys[5] = rb_intern("day_count");
+  // rb_get_kwargs() deletes what it finds, and _remember_solution() and _solver_result() still need to see it
+  rb_get_kwargs(rb_hash_dup(kwargs), keys, 0, cache == NO_CACHE ? 2 : cache == SPREAD_CACHE ? 5 : 6, values);
+
+  if (values[0] != Qundef) {
+    if (values[0] == ID2SYM(rb_intern("secant")))
+      opts.method = CH_SECANT;
+    else if (values[0] == ID2SYM(rb_intern("newton")))
+      opts.method = CH_NEWTON;
+    else if (values[0] == ID2SYM(rb_intern("brent")))
+      opts.method = CH_BRENT;
+    else
+      rb_raise(rb_eArgError, "unknown solver method %"PRIsVALUE" (expected :secant, :newton or :brent)", values[0]);
+  }
+
+  if (values[1] != Qundef && !NIL_P(values[1])) {
+    opts.guess = NUM2DBL(values[1]);
+  } else if (cache != NO_CACHE && values[2] != Qundef) {
+    VALUE cached = rb_hash_lookup(cache == IRR_CACHE ? irr_cache : spread_cache, values[2]);
+    if (!NIL_P(cached))
+      opts.guess = NUM2DBL(cached);
+  }
+
+  if (cache == IRR_CACHE && values[5] != Qundef)
+    opts.day_count = _get_day_count(values[5]);
+
+  return opts;
+}
+
+
+/* _remember_solution()
+ * internal function that, if the solve was given a loan_id and converged, caches the result as the starting point for
+ * that loan's next solve
+ */
+void _remember_solution(VALUE kwargs, int cache, double c_result) {
+  VALUE loan_id;
+
+  if (NIL_P(kwargs) || _status_of(c_result) != 0)
+    return;
+
+  loan_id = rb_hash_lookup2(kwargs, ID2SYM(rb_intern("loan_id")), Qundef);
+  if (loan_id != Qundef)
+    rb_hash_aset(cache == IRR_CACHE ? irr_cache : spread_cache, loan_id, rb_float_new(c_result));
+}
+
+
+/* clear_solution_cache
+ * exported function that forgets every cached starting point
+ */
+VALUE clear_solution_cache(VALUE _self) {
+  rb_hash_clear(spread_cache);
+  rb_hash_clear(irr_cache);
+  return Qnil;
+}
+
+
+/* _result_or_raise()
+ * internal function that turns a value returned by _backsolve_cf() or _backsolve_irr() into the Float handed back to
+ * Ruby, raising for the sentinels
+ */
+VALUE _result_or_raise(double c_result) {
+  if (c_result == CH_NO_SENSITIVITY) {
+    rb_raise(rb_eZeroDivError, "value doesn't change when yield is sensitized");
+    return Qnil;
+  } else if (c_result == CH_FAILED_TO_CONVERGE) {
+    rb_raise(rb_eRuntimeError, "failed to converge");
+    return Qnil;
+  } else if (c_result == CH_NO_BRACKET) {
+    rb_raise(rb_eRuntimeError, "couldn't bracket a root");
+    return Qnil;
+  } else if (c_result == CH_NO_MEMORY) {
+    rb_raise(rb_eNoMemError, "failed to allocate memory for solver");
+    return Qnil;
   }
   
-  if (trials >= max_tries)
-    return -998.0;
-  
-  return x_n;
+  VALUE result = rb_float_new(c_result);
+  return result;
 }
 
 
-/* _backsolve_irr()
- * internal function that applies a Newton-Raphson algorithm to find, for a given set of cash flows,
- * what IRR will get to an NPV of 0.0.
+static VALUE result_class, risk_class;
+
+
+/* _wants_risk()
+ * internal function that says whether the caller passed risk: true
+ */
+int _wants_risk(VALUE kwargs) {
+  return !NIL_P(kwargs) && RTEST(rb_hash_lookup(kwargs, ID2SYM(rb_intern("risk"))));
+}
+
+
+/* _risk_struct()
+ * internal function that builds the CHelper::Risk for a converged solve from the PV and derivatives worked out by
+ * _compute_pv_risk() or _compute_pv_for_irr_risk(): value (the spread or IRR), pv, dpv and d2pv, then
+ * modified_duration = -dpv / pv, convexity = d2pv / pv and dv01 = -dpv / 10000, the PV gained per 1bp fall
+ */
+static VALUE _risk_struct(double c_result, double *risk) {
+  return rb_struct_new(risk_class, rb_float_new(c_result), rb_float_new(risk[0]), rb_float_new(risk[1]), rb_float_new(risk[2]),
+    rb_float_new(-risk[1] / risk[0]), rb_float_new(risk[2] / risk[0]), rb_float_new(-risk[1] * 0.0001));
+}
+
+
+/* _solver_result()
+ * internal function that hands a single solve's result back to Ruby: the Float from _result_or_raise(), or, when the
+ * caller passed exception: false, a CHelper::Result (value, status, iterations, residual) that is returned whether or
+ * not the solve converged, so a loop over a bad tape doesn't pay for building and unwinding an exception per loan
  *
- * note that the NPV isn't a price (% of par), but rather a total dollar amount
+ * value is nil unless status is 0 (CHelper::STATUS_OK); residual is target NPV less the NPV where the solver stopped
  *
- * assumes that arrays are allocated and num_cfs in length
- * assumes that -999.0 and -998.0 will never be valid return values for spreads
+ * risk is the job's risk buffer: if not NULL, a converged value comes back as a CHelper::Risk rather than a Float
  */
-double _backsolve_irr(double *cfs, double *dates, long num_cfs, double res, long max_tries, char is_clean, double accrued_interest) {
-  double x_n_minus_1 = 0.06; // starting point of 6%
-  double x_n = x_n_minus_1 + 0.0025;
-  double x_n_plus_1;
-  double f_n_minus_1, f_n;
-  double target_px = 0.0;
-  
-  f_n_minus_1 = target_px - _compute_pv_for_irr(cfs, dates, num_cfs, is_clean, accrued_interest, x_n_minus_1);
-  f_n         = target_px - _compute_pv_for_irr(cfs, dates, num_cfs, is_clean, accrued_interest, x_n        );
-  
-  long trials = 0;
-  
-  while (ABS(f_n) > res && trials < max_tries) {
-    if (f_n == f_n_minus_1) {
-      return -999.0;
-      // ERROR! Can't divide by 0
-    }
-    x_n_plus_1    = x_n - f_n * (x_n - x_n_minus_1) / (f_n - f_n_minus_1);
-    x_n_minus_1   = x_n;
-    x_n           = x_n_plus_1;
-
-    f_n_minus_1   = f_n;   // previous result
-    f_n           = target_px - _compute_pv_for_irr(cfs, dates, num_cfs, is_clean, accrued_interest, x_n);
-    
-    trials++;
+VALUE _solver_result(VALUE kwargs, double c_result, solver_opts *opts, double *risk) {
+  int status = _status_of(c_result);
+  VALUE value;
+
+  if (NIL_P(kwargs) || rb_hash_lookup2(kwargs, ID2SYM(rb_intern("exception")), Qtrue) != Qfalse) {
+    value = _result_or_raise(c_result);
+    return risk != NULL ? _risk_struct(c_result, risk) : value;
   }
-  
-  if (trials >= max_tries)
-    return -998.0;
-  
-  return x_n;
+
+  value = status != 0 ? Qnil : risk != NULL ? _risk_struct(c_result, risk) : rb_float_new(c_result);
+  return rb_struct_new(result_class, value, INT2FIX(status), LONG2NUM(opts->iterations), rb_float_new(opts->residual));
+}
+
+
+/* Result#ok?
+ * true if the solve converged
+ */
+static VALUE result_ok_p(VALUE self) {
+  return rb_struct_aref(self, INT2FIX(1)) == INT2FIX(0) ? Qtrue : Qfalse;
 }
 
 
@@ -164,16 +315,36 @@ double _backsolve_irr(double *cfs, double *dates, long num_cfs, double res, long
  * exported function that is called from Ruby to compute the backsolved spread or yield; main function is data wrangling
  * from Ruby to C and vice versa, then calling the internal functions
  *
+ * the inputs are copied out of the Ruby arrays first, and the solve itself runs without the GVL
+ *
+ * keyword options after the positional arguments tune the solver; see _get_solver_opts()
+ *
+ * libor can also be a CHelper::Curve, which is read at each of the dates
+ *
  * assumes that is_clean is a boolean True or False
  * assumes that the Ruby arrays cfs, dates, and libor are of length num_cfs
  * assumes that the numeric classes are as per below, and Ruby won't, e.g., throw in a BigNum or some other class
  * assumes that the Check_Type code will not just raise a Ruby exception, but will also safely exit the function without
  *  allocating bad memory etc. and proceeding with the C code further down
  */
-VALUE backsolve_cf(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE num_cfs, VALUE target_px, VALUE res, VALUE max_tries, VALUE is_clean, VALUE accrued_interest, VALUE year_convention) {
+VALUE backsolve_cf(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 10);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE libor = argv[2];
+  VALUE num_cfs = argv[3];
+  VALUE target_px = argv[4];
+  VALUE res = argv[5];
+  VALUE max_tries = argv[6];
+  VALUE is_clean = argv[7];
+  VALUE accrued_interest = argv[8];
+  VALUE year_convention = argv[9];
   Check_Type(cfs,               T_ARRAY);
   Check_Type(dates,             T_ARRAY);
-  Check_Type(libor,             T_ARRAY);
+  ch_curve *curve = _get_curve(libor);
+  if (curve == NULL)
+    Check_Type(libor,           T_ARRAY);
   Check_Type(num_cfs,           T_FIXNUM);
   Check_Type(target_px,         T_FLOAT);
   Check_Type(res,               T_FLOAT);
@@ -181,6 +352,7 @@ VALUE backsolve_cf(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE num_c
   //Check_Type(is_clean,   T_TRUE); Ruby doesn't have a Boolean class
   Check_Type(accrued_interest,  T_FLOAT);
   Check_Type(year_convention,   T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, SPREAD_CACHE);
   
   double *c_cfs, *c_dates, *c_libor;
   double prev_date;
@@ -192,9 +364,9 @@ VALUE backsolve_cf(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE num_c
   }
   
   // allocate memory
-  c_cfs   = malloc(c_num_cfs * sizeof(double)); if (c_cfs == NULL) { rb_raise(rb_eNoMemError, "failed to allocate memory for c_cfs"); return Qnil; }
-  c_dates = malloc(c_num_cfs * sizeof(double)); if (c_cfs == NULL) { free(c_cfs); rb_raise(rb_eNoMemError, "failed to allocate memory for c_dates"); return Qnil; }
-  c_libor = malloc(c_num_cfs * sizeof(double)); if (c_cfs == NULL) { free(c_cfs); free(c_dates); rb_raise(rb_eNoMemError, "failed to allocate memory for c_libor"); return Qnil; }
+  c_cfs   = malloc(c_num_cfs * sizeof(double)); if (c_cfs   == NULL) { rb_raise(rb_eNoMemError, "failed to allocate memory for c_cfs"); return Qnil; }
+  c_dates = malloc(c_num_cfs * sizeof(double)); if (c_dates == NULL) { free(c_cfs); rb_raise(rb_eNoMemError, "failed to allocate memory for c_dates"); return Qnil; }
+  c_libor = malloc(c_num_cfs * sizeof(double)); if (c_libor == NULL) { free(c_cfs); free(c_dates); rb_raise(rb_eNoMemError, "failed to allocate memory for c_libor"); return Qnil; }
   
   // TODO: handle errors, what if the Ruby array is not the right length?
   long i;
@@ -208,34 +380,226 @@ VALUE backsolve_cf(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE num_c
       return Qnil;
     }
     prev_date = c_dates[i];
-    c_libor[i] = NUM2DBL(rb_ary_entry(libor, i));
+    if (curve == NULL)
+      c_libor[i] = NUM2DBL(rb_ary_entry(libor, i));
   }
+  if (curve != NULL)
+    _curve_rates(curve, c_dates, c_num_cfs, c_libor);
   
-  // call internal function to compute result
-  double c_result = _backsolve_cf(c_cfs, c_dates, c_libor,
-    c_num_cfs,
-    NUM2DBL(target_px),
-    NUM2DBL(res),
-    NUM2LONG(max_tries),
+  // call internal function to compute result, without the GVL
+  double c_target_px = NUM2DBL(target_px), c_accrued_interest = NUM2DBL(accrued_interest), c_result = 0.0, c_risk[3];
+  solve_job job = { c_cfs, c_dates, c_libor, &c_num_cfs, &c_target_px, &c_accrued_interest, &c_result, 1,
     TYPE(is_clean) == T_TRUE ? 1 : 0,
-    NUM2DBL(accrued_interest),
-    NUM2DBL(year_convention));
+    NUM2DBL(year_convention),
+    opts };
+  job.risk = _wants_risk(kwargs) ? c_risk : NULL;
+  int state = _solve_without_gvl(&job, started);
   
     // free memory
   free(c_cfs);
   free(c_dates);
   free(c_libor);
   
-  if (c_result == -999.0) {
-    rb_raise(rb_eZeroDivError, "value doesn't change when yield is sensitized");
+  if (state)
+    rb_jump_tag(state);
+  
+  _remember_solution(kwargs, SPREAD_CACHE, c_result);
+  return _solver_result(kwargs, c_result, &job.opts, job.risk);
+}
+
+
+/* _batch_total_cfs()
+ * internal function for the batch functions that checks the type of each loan's cfs, dates and libor (an Array, or a
+ * CHelper::Curve unless there's a shared_curve for every loan) and returns the total number of cash flows, so the
+ * shared buffers can be sized before anything is allocated
+ */
+long _batch_total_cfs(VALUE cfs_list, VALUE dates_list, VALUE libor_list, ch_curve *shared_curve) {
+  long i, total_cfs = 0;
+
+  for (i = 0; i < RARRAY_LEN(cfs_list); i++) {
+    Check_Type(rb_ary_entry(cfs_list,   i), T_ARRAY);
+    Check_Type(rb_ary_entry(dates_list, i), T_ARRAY);
+    if (shared_curve == NULL && _get_curve(rb_ary_entry(libor_list, i)) == NULL)
+      Check_Type(rb_ary_entry(libor_list, i), T_ARRAY);
+    total_cfs += RARRAY_LEN(rb_ary_entry(cfs_list, i));
+  }
+
+  return total_cfs;
+}
+
+
+/* _pack_loan()
+ * internal function for the batch functions that copies loan i's cash flows, dates and libor into the shared buffers
+ * at cfs, dates and libor (room for RARRAY_LEN(cfs_list[i]) each); returns 0.0, or CH_NO_CASH_FLOWS or
+ * CH_INVALID_INPUT for a loan that can't be priced, so that the loan gets a status rather than failing the batch
+ *
+ * assumes the lists were checked by _batch_total_cfs()
+ */
+double _pack_loan(VALUE cfs_list, VALUE dates_list, VALUE libor_list, ch_curve *shared_curve, long i, double *cfs, double *dates, double *libor) {
+  VALUE loan_cfs   = rb_ary_entry(cfs_list,   i);
+  VALUE loan_dates = rb_ary_entry(dates_list, i);
+  VALUE loan_libor = shared_curve == NULL ? rb_ary_entry(libor_list, i) : Qnil;
+  ch_curve *curve  = shared_curve == NULL ? _get_curve(loan_libor) : shared_curve;
+  long t, num_cfs = RARRAY_LEN(loan_cfs);
+  double prev_date = 0.0, result = 0.0;
+
+  if (num_cfs < 1)
+    return CH_NO_CASH_FLOWS;
+  if (RARRAY_LEN(loan_dates) != num_cfs || (curve == NULL && RARRAY_LEN(loan_libor) != num_cfs))
+    return CH_INVALID_INPUT;
+
+  for (t = 0; t < num_cfs; t++) {
+    cfs[t]   = NUM2DBL(rb_ary_entry(loan_cfs,   t));
+    dates[t] = NUM2DBL(rb_ary_entry(loan_dates, t));
+    if (curve == NULL)
+      libor[t] = NUM2DBL(rb_ary_entry(loan_libor, t));
+    if (dates[t] <= prev_date)
+      result = CH_INVALID_INPUT;
+    prev_date = dates[t];
+  }
+  if (curve != NULL)
+    _curve_rates(curve, dates, num_cfs, libor);
+
+  return result;
+}
+
+
+/* backsolve_cf_batch
+ * exported function that backsolves the spread or yield for a whole portfolio in one call, so the per-loan round trip
+ * through Ruby goes away; loan i is cfs_list[i], dates_list[i], libor_list[i], target_pxs[i] and accrued_interests[i],
+ * while res, max_tries, is_clean and year_convention apply to every loan
+ *
+ * returns [spreads, statuses], where spreads[i] is a Float (nil if loan i didn't solve) and statuses[i] is 0 or one of
+ * the CHelper::STATUS_* codes; a bad loan gets a status rather than raising, so it doesn't throw away the whole batch
+ *
+ * all cash flows are copied into one set of contiguous buffers, so the allocations are per batch rather than per loan,
+ * and then the whole batch is solved without the GVL; takes the same keyword options as backsolve_cf, except that
+ * loan_id: becomes loan_ids: (one per loan), and there's also guesses: (one per loan, nil for "no guess"); a loan's
+ * guess beats its cached solution, which beats guess:
+ *
+ * libor_list can be a single CHelper::Curve for every loan, and any loan's libor can be a Curve
+ *
+ * with risk: true it returns [spreads, statuses, risks] instead, where risks[i] is loan i's CHelper::Risk (nil if it
+ * didn't solve)
+ *
+ * assumes that is_clean is a boolean True or False
+ * assumes that the numeric classes are as per below, and Ruby won't, e.g., throw in a BigNum or some other class
+ */
+VALUE backsolve_cf_batch(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 9);
+  VALUE cfs_list = argv[0];
+  VALUE dates_list = argv[1];
+  VALUE libor_list = argv[2];
+  VALUE target_pxs = argv[3];
+  VALUE res = argv[4];
+  VALUE max_tries = argv[5];
+  VALUE is_clean = argv[6];
+  VALUE accrued_interests = argv[7];
+  VALUE year_convention = argv[8];
+  Check_Type(cfs_list,          T_ARRAY);
+  Check_Type(dates_list,        T_ARRAY);
+  ch_curve *shared_curve = _get_curve(libor_list);
+  if (shared_curve == NULL)
+    Check_Type(libor_list,      T_ARRAY);
+  Check_Type(target_pxs,        T_ARRAY);
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interests, T_ARRAY);
+  Check_Type(year_convention,   T_FLOAT);
+
+  long num_loans = RARRAY_LEN(cfs_list);
+  long i;
+
+  if (RARRAY_LEN(dates_list) != num_loans || (shared_curve == NULL && RARRAY_LEN(libor_list) != num_loans) ||
+      RARRAY_LEN(target_pxs) != num_loans || RARRAY_LEN(accrued_interests) != num_loans) {
+    rb_raise(rb_eArgError, "cfs, dates, libor, target_px and accrued_interest lists must all have one entry per loan");
     return Qnil;
-  } else if (c_result == -998.0) {
-    rb_raise(rb_eRuntimeError, "failed to converge");
+  }
+
+  // the per-loan options are ours; the rest go through _get_solver_opts() as usual
+  VALUE loan_ids = Qnil, guesses = Qnil, risk = Qnil;
+  if (!NIL_P(kwargs)) {
+    kwargs   = rb_hash_dup(kwargs);
+    loan_ids = rb_hash_delete(kwargs, ID2SYM(rb_intern("loan_ids")));
+    guesses  = rb_hash_delete(kwargs, ID2SYM(rb_intern("guesses")));
+    risk     = rb_hash_delete(kwargs, ID2SYM(rb_intern("risk")));
+  }
+  if (!NIL_P(loan_ids)) Check_Type(loan_ids, T_ARRAY);
+  if (!NIL_P(guesses))  Check_Type(guesses,  T_ARRAY);
+  if ((!NIL_P(loan_ids) && RARRAY_LEN(loan_ids) != num_loans) || (!NIL_P(guesses) && RARRAY_LEN(guesses) != num_loans)) {
+    rb_raise(rb_eArgError, "loan_ids and guesses must have one entry per loan");
     return Qnil;
   }
-  
-  VALUE result = rb_float_new(c_result);
-  return result;
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, NO_CACHE);
+
+  // check types and size the shared buffers before allocating anything
+  long total_cfs = _batch_total_cfs(cfs_list, dates_list, libor_list, shared_curve);
+
+  // allocate memory; it all belongs to the GC, so nothing leaks if a NUM2DBL() below raises
+  VALUE cfs_holder, dates_holder, libor_holder, num_cfs_holder, target_px_holder, accrued_holder, results_holder,
+    guesses_holder, risk_holder = Qnil;
+  double *c_cfs              = _alloc_doubles(total_cfs, &cfs_holder);
+  double *c_dates            = _alloc_doubles(total_cfs, &dates_holder);
+  double *c_libor            = _alloc_doubles(total_cfs, &libor_holder);
+  long   *c_num_cfs          = ALLOCV_N(long, num_cfs_holder, num_loans + 1);
+  double *c_target_px        = _alloc_doubles(num_loans, &target_px_holder);
+  double *c_accrued_interest = _alloc_doubles(num_loans, &accrued_holder);
+  double *c_results          = _alloc_doubles(num_loans, &results_holder);
+  double *c_guesses          = _alloc_doubles(num_loans, &guesses_holder);
+  double *c_risk             = RTEST(risk) ? _alloc_doubles(3 * num_loans, &risk_holder) : NULL;
+
+  long offset = 0;
+  for (i = 0; i < num_loans; i++) {
+    c_num_cfs[i]          = RARRAY_LEN(rb_ary_entry(cfs_list, i));
+    c_target_px[i]        = NUM2DBL(rb_ary_entry(target_pxs, i));
+    c_accrued_interest[i] = NUM2DBL(rb_ary_entry(accrued_interests, i));
+
+    VALUE guess = NIL_P(guesses) ? Qnil : rb_ary_entry(guesses, i);
+    if (NIL_P(guess) && !NIL_P(loan_ids))
+      guess = rb_hash_lookup(spread_cache, rb_ary_entry(loan_ids, i));
+    c_guesses[i] = NIL_P(guess) ? opts.guess : NUM2DBL(guess);
+
+    c_results[i] = _pack_loan(cfs_list, dates_list, libor_list, shared_curve, i, c_cfs + offset, c_dates + offset, c_libor + offset);
+    offset += c_num_cfs[i];
+  }
+
+  // solve every loan without the GVL
+  solve_job job = { c_cfs, c_dates, c_libor, c_num_cfs, c_target_px, c_accrued_interest, c_results, num_loans,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(year_convention),
+    opts,
+    c_guesses,
+    c_risk };
+  int state = _solve_without_gvl(&job, started);
+
+  VALUE spreads  = rb_ary_new_capa(num_loans);
+  VALUE statuses = rb_ary_new_capa(num_loans);
+  VALUE risks    = RTEST(risk) ? rb_ary_new_capa(num_loans) : Qnil;
+  for (i = 0; i < num_loans && !state; i++) {
+    int status = _status_of(c_results[i]);
+    rb_ary_push(spreads,  status == 0 ? rb_float_new(c_results[i]) : Qnil);
+    rb_ary_push(statuses, INT2FIX(status));
+    if (RTEST(risk))
+      rb_ary_push(risks, status == 0 ? _risk_struct(c_results[i], c_risk + 3 * i) : Qnil);
+    if (status == 0 && !NIL_P(loan_ids))
+      rb_hash_aset(spread_cache, rb_ary_entry(loan_ids, i), rb_float_new(c_results[i]));
+  }
+
+  RB_GC_GUARD(cfs_holder);
+  RB_GC_GUARD(dates_holder);
+  RB_GC_GUARD(libor_holder);
+  RB_GC_GUARD(target_px_holder);
+  RB_GC_GUARD(accrued_holder);
+  RB_GC_GUARD(results_holder);
+  RB_GC_GUARD(guesses_holder);
+  RB_GC_GUARD(risk_holder);
+  ALLOCV_END(num_cfs_holder);
+
+  if (state)
+    rb_jump_tag(state);
+
+  return RTEST(risk) ? rb_ary_new_from_args(3, spreads, statuses, risks) : rb_assoc_new(spreads, statuses);
 }
 
 
@@ -243,13 +607,24 @@ VALUE backsolve_cf(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE num_c
  * exported function that is called from Ruby to compute the backsolved spread or yield; main function is data wrangling
  * from Ruby to C and vice versa, then calling the internal functions
  *
+ * as with backsolve_cf, the solve runs without the GVL and takes the same keyword options
+ *
  * assumes that is_clean is a boolean True or False
  * assumes that the Ruby arrays cfs, dates, and libor are of length num_cfs
  * assumes that the numeric classes are as per below, and Ruby won't, e.g., throw in a BigNum or some other class
  * assumes that the Check_Type code will not just raise a Ruby exception, but will also safely exit the function without
  *  allocating bad memory etc. and proceeding with the C code further down
  */
-VALUE backsolve_irr(VALUE _self, VALUE cfs, VALUE dates, VALUE num_cfs, VALUE res, VALUE max_tries, VALUE is_clean, VALUE accrued_interest) {
+VALUE backsolve_irr(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 7);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE num_cfs = argv[2];
+  VALUE res = argv[3];
+  VALUE max_tries = argv[4];
+  VALUE is_clean = argv[5];
+  VALUE accrued_interest = argv[6];
   Check_Type(cfs,               T_ARRAY);
   Check_Type(dates,             T_ARRAY);
   Check_Type(num_cfs,           T_FIXNUM);
@@ -257,6 +632,7 @@ VALUE backsolve_irr(VALUE _self, VALUE cfs, VALUE dates, VALUE num_cfs, VALUE re
   Check_Type(max_tries,         T_FIXNUM);
   //Check_Type(is_clean,   T_TRUE); Ruby doesn't have a Boolean class
   Check_Type(accrued_interest,  T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, IRR_CACHE);
   
   double *c_cfs, *c_dates;
   double prev_date;
@@ -268,8 +644,8 @@ VALUE backsolve_irr(VALUE _self, VALUE cfs, VALUE dates, VALUE num_cfs, VALUE re
   }
   
   // allocate memory
-  c_cfs   = malloc(c_num_cfs * sizeof(double)); if (c_cfs == NULL) { rb_raise(rb_eNoMemError, "failed to allocate memory for c_cfs"); return Qnil; }
-  c_dates = malloc(c_num_cfs * sizeof(double)); if (c_cfs == NULL) { free(c_cfs); rb_raise(rb_eNoMemError, "failed to allocate memory for c_dates"); return Qnil; }
+  c_cfs   = malloc(c_num_cfs * sizeof(double)); if (c_cfs   == NULL) { rb_raise(rb_eNoMemError, "failed to allocate memory for c_cfs"); return Qnil; }
+  c_dates = malloc(c_num_cfs * sizeof(double)); if (c_dates == NULL) { free(c_cfs); rb_raise(rb_eNoMemError, "failed to allocate memory for c_dates"); return Qnil; }
   
   // TODO: handle errors, what if the Ruby array is not the right length?
   long i;
@@ -285,33 +661,326 @@ VALUE backsolve_irr(VALUE _self, VALUE cfs, VALUE dates, VALUE num_cfs, VALUE re
     prev_date = c_dates[i];
   }
   
-  // call internal function to compute result
-  double c_result = _backsolve_irr(c_cfs, c_dates,
-    c_num_cfs,
-    NUM2DBL(res),
-    NUM2LONG(max_tries),
+  // call internal function to compute result, without the GVL
+  double c_accrued_interest = NUM2DBL(accrued_interest), c_result = 0.0, c_risk[3];
+  solve_job job = { c_cfs, c_dates, NULL, &c_num_cfs, NULL, &c_accrued_interest, &c_result, 1,
     TYPE(is_clean) == T_TRUE ? 1 : 0,
-    NUM2DBL(accrued_interest));
+    0.0,
+    opts };
+  job.risk = _wants_risk(kwargs) ? c_risk : NULL;
+  int state = _solve_without_gvl(&job, started);
   
     // free memory
   free(c_cfs);
   free(c_dates);
   
-  if (c_result == -999.0) {
-    rb_raise(rb_eZeroDivError, "value doesn't change when yield is sensitized");
-    return Qnil;
-  } else if (c_result == -998.0) {
-    rb_raise(rb_eRuntimeError, "failed to converge");
-    return Qnil;
-  }
+  if (state)
+    rb_jump_tag(state);
   
-  VALUE result = rb_float_new(c_result);
-  return result;
+  _remember_solution(kwargs, IRR_CACHE, c_result);
+  return _solver_result(kwargs, c_result, &job.opts, job.risk);
+}
+
+
+/* _get_packed_inputs()
+ * internal function that gets the packed buffers for cfs, dates and (unless bufs[2] is NULL) libor, which may also be
+ * a CHelper::Curve (see _get_libor_buffer()), then checks them
+ * the same way backsolve_cf checks its arrays; dates must be strictly increasing from a value > 0 when strict_dates is
+ * set, or just non-decreasing otherwise (as for IRRs)
+ *
+ * raises, having released the buffers, if anything is wrong
+ */
+void _get_packed_inputs(VALUE cfs, VALUE dates, VALUE libor, double_buffer *bufs[3], char strict_dates) {
+  const char *err = NULL;
+  long i;
+
+  if ((err = _get_double_buffer(cfs, bufs[0])) != NULL || (err = _get_double_buffer(dates, bufs[1])) != NULL ||
+      (bufs[2] != NULL && (err = _get_libor_buffer(libor, bufs[1]->ptr, bufs[1]->len, bufs[2])) != NULL)) {
+    for (i = 0; i < 3; i++)
+      if (bufs[i] != NULL) _release_double_buffer(bufs[i]);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  if (bufs[0]->len < 1)
+    err = "valid array of cash flows must have at least one entry";
+  else if (bufs[1]->len != bufs[0]->len || (bufs[2] != NULL && bufs[2]->len != bufs[0]->len))
+    err = "cfs, dates and libor must all have the same number of entries";
+  for (i = 0; err == NULL && i < bufs[1]->len; i++) {
+    double prev_date = i > 0 ? bufs[1]->ptr[i - 1] : 0.0;
+    if (strict_dates ? bufs[1]->ptr[i] <= prev_date : bufs[1]->ptr[i] < prev_date)
+      err = "dates must contain a list of monotonically increasing values, starting at a value > 0";
+  }
+
+  if (err != NULL) {
+    for (i = 0; i < 3; i++)
+      if (bufs[i] != NULL) _release_double_buffer(bufs[i]);
+    rb_raise(rb_eRuntimeError, "%s", err);
+  }
+}
+
+
+/* backsolve_cf_packed
+ * exported function that works like backsolve_cf, but takes cfs, dates and libor as packed buffers of doubles
+ * (Array#pack('d*') Strings, or anything exporting a MemoryView of doubles) and hands their memory straight to
+ * _backsolve_cf() with no conversion or copy; num_cfs is implied by the length of the buffers
+ *
+ * takes the same keyword options as backsolve_cf
+ */
+VALUE backsolve_cf_packed(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 9);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE libor = argv[2];
+  VALUE target_px = argv[3];
+  VALUE res = argv[4];
+  VALUE max_tries = argv[5];
+  VALUE is_clean = argv[6];
+  VALUE accrued_interest = argv[7];
+  VALUE year_convention = argv[8];
+  Check_Type(target_px,         T_FLOAT);
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, SPREAD_CACHE);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT, c_libor = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, &c_libor };
+  _get_packed_inputs(cfs, dates, libor, bufs, 1);
+
+  double c_target_px = NUM2DBL(target_px), c_accrued_interest = NUM2DBL(accrued_interest), c_result = 0.0, c_risk[3];
+  solve_job job = { c_cfs.ptr, c_dates.ptr, c_libor.ptr, &c_cfs.len, &c_target_px, &c_accrued_interest, &c_result, 1,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(year_convention),
+    opts };
+  job.risk = _wants_risk(kwargs) ? c_risk : NULL;
+  int state = _solve_without_gvl(&job, started);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_libor);
+
+  if (state)
+    rb_jump_tag(state);
+
+  _remember_solution(kwargs, SPREAD_CACHE, c_result);
+  return _solver_result(kwargs, c_result, &job.opts, job.risk);
+}
+
+
+/* backsolve_irr_packed
+ * exported function that is to backsolve_irr what backsolve_cf_packed is to backsolve_cf
+ */
+VALUE backsolve_irr_packed(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 6);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE res = argv[2];
+  VALUE max_tries = argv[3];
+  VALUE is_clean = argv[4];
+  VALUE accrued_interest = argv[5];
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, IRR_CACHE);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, NULL };
+  _get_packed_inputs(cfs, dates, Qnil, bufs, 0);
+
+  double c_accrued_interest = NUM2DBL(accrued_interest), c_result = 0.0, c_risk[3];
+  solve_job job = { c_cfs.ptr, c_dates.ptr, NULL, &c_cfs.len, NULL, &c_accrued_interest, &c_result, 1,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    0.0,
+    opts };
+  job.risk = _wants_risk(kwargs) ? c_risk : NULL;
+  int state = _solve_without_gvl(&job, started);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+
+  if (state)
+    rb_jump_tag(state);
+
+  _remember_solution(kwargs, IRR_CACHE, c_result);
+  return _solver_result(kwargs, c_result, &job.opts, job.risk);
+}
+
+
+typedef struct {
+  double *cfs, *dates;
+  long num_cfs;
+  char is_clean;
+  double accrued_interest, lower, upper;
+  long steps;
+  solver_opts opts;
+  double *roots;
+  VALUE roots_holder;
+  double result;  // what _irr_roots() returned
+  volatile int interrupted;
+} xirr_job;
+
+static void *_run_xirr_job(void *data) {
+  xirr_job *job = (xirr_job *)data;
+  job->opts.interrupted = &job->interrupted;
+  job->result = _irr_roots(job->cfs, job->dates, job->num_cfs, job->is_clean, job->accrued_interest, job->lower, job->upper,
+    job->steps, &job->opts, job->roots);
+  return NULL;
+}
+
+static void _unblock_xirr_job(void *data) {
+  ((xirr_job *)data)->interrupted = 1;
+}
+
+static VALUE _call_xirr_job(VALUE data) {
+  xirr_job *job = (xirr_job *)data;
+
+  // allocated in here, under xirr's rb_protect(), so that if it raises the input buffers still get released
+  job->roots = _alloc_doubles(job->num_cfs, &job->roots_holder);
+
+  // an interrupted scan is simply rerun if servicing the interrupt didn't raise
+  do {
+    job->interrupted = 0;
+    rb_thread_call_without_gvl(_run_xirr_job, job, _unblock_xirr_job, job);
+  } while (job->result == CH_INTERRUPTED);
+
+  return Qnil;
+}
+
+
+/* xirr
+ * exported function that finds the IRR of a stream whose cash flows may change sign more than once (e.g. a fund's
+ * calls and distributions), where backsolve_irr can fail or land on whichever root is nearest 6%: every IRR between
+ * lower: and upper: is bracketed and solved for in one pass (see _irr_roots())
+ *
+ * CHelper.xirr(cfs, dates, res, max_tries, is_clean, accrued_interest, all: false, guess: nil, lower: -0.99,
+ *              upper: 10.0, steps: 200, day_count: :act_365f, exception: true)
+ *
+ * cfs and dates are taken as in backsolve_irr_packed (Arrays or packed buffers). With all: true, returns every IRR
+ * found, ascending (empty if there's none); otherwise the one nearest guess: (6% by default), raising as
+ * backsolve_irr does if there's none (or returning a CHelper::Result, with exception: false). The scan runs without
+ * the GVL
+ *
+ * assumes that is_clean is a boolean True or False
+ */
+VALUE xirr(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 6);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE res = argv[2];
+  VALUE max_tries = argv[3];
+  VALUE is_clean = argv[4];
+  VALUE accrued_interest = argv[5];
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+
+  // all:, lower:, upper: and steps: are ours; guess: goes through _get_solver_opts(), and exception: to _solver_result()
+  VALUE solver_kwargs = Qnil, all = Qnil, lower = Qnil, upper = Qnil, steps = Qnil, day_count = Qnil;
+  if (!NIL_P(kwargs)) {
+    solver_kwargs = rb_hash_dup(kwargs);
+    all   = rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("all")));
+    lower = rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("lower")));
+    upper = rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("upper")));
+    steps = rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("steps")));
+    day_count = rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("day_count")));
+    rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("exception")));
+    if (!NIL_P(rb_hash_lookup(solver_kwargs, ID2SYM(rb_intern("method")))))
+      rb_raise(rb_eArgError, "xirr always uses Brent's method");
+  }
+  solver_opts opts = _get_solver_opts(res, max_tries, solver_kwargs, NO_CACHE);
+  opts.day_count = _get_day_count(day_count);
+  if (!NIL_P(lower)) Check_Type(lower, T_FLOAT);
+  if (!NIL_P(upper)) Check_Type(upper, T_FLOAT);
+  if (!NIL_P(steps)) Check_Type(steps, T_FIXNUM);
+
+  double c_lower = NIL_P(lower) ? -0.99 : NUM2DBL(lower), c_upper = NIL_P(upper) ? 10.0 : NUM2DBL(upper);
+  long c_steps = NIL_P(steps) ? 200 : FIX2LONG(steps);
+  if (!(c_lower > -1.0 && c_upper > c_lower) || c_steps < 1)
+    rb_raise(rb_eArgError, "need -1.0 < lower < upper and steps > 0");
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, NULL };
+  _get_packed_inputs(cfs, dates, Qnil, bufs, 0);
+
+  xirr_job job = { c_cfs.ptr, c_dates.ptr, c_cfs.len,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(accrued_interest),
+    c_lower, c_upper, c_steps,
+    opts,
+    NULL, Qnil };
+  long solve_started = _clock_ns();
+  int state = 0;
+  rb_protect(_call_xirr_job, (VALUE)&job, &state);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+
+  if (state)
+    rb_jump_tag(state);
+
+  // the relevant root is the one nearest the guess; no root at all is reported as no bracket
+  long i, num_roots = job.result >= 0.0 ? (long)job.result : 0;
+  double c_result = job.result < 0.0 ? job.result : CH_NO_BRACKET;
+  for (i = 0; i < num_roots; i++)
+    if (i == 0 || fabs(job.roots[i] - job.opts.guess) < fabs(c_result - job.opts.guess))
+      c_result = job.roots[i];
+
+  // the scan's evaluations are counted as iterations (see _irr_roots()), and there are no seeds on top of them
+  solver_stats stats = { 0 };
+  _count_solve(&stats, c_result, &job.opts);
+  if (c_result != CH_NO_MEMORY)
+    stats.pv_evaluations = job.opts.iterations;
+  _record_stats(&stats, started, solve_started, _clock_ns());
+
+  if (RTEST(all) && job.result >= 0.0) {
+    VALUE roots = rb_ary_new_capa(num_roots);
+    for (i = 0; i < num_roots; i++)
+      rb_ary_push(roots, rb_float_new(job.roots[i]));
+    RB_GC_GUARD(job.roots_holder);
+    return roots;
+  }
+
+  RB_GC_GUARD(job.roots_holder);
+  return _solver_result(kwargs, c_result, &job.opts, NULL);
 }
 
 
 void Init_c_helper() {
   VALUE mod = rb_define_module("CHelper");
-  rb_define_module_function(mod, "backsolve_cf", backsolve_cf, 10);
-  rb_define_module_function(mod, "backsolve_irr", backsolve_irr, 7);
-}
+  rb_define_module_function(mod, "backsolve_cf", backsolve_cf, -1);
+  rb_define_module_function(mod, "backsolve_irr", backsolve_irr, -1);
+  rb_define_module_function(mod, "backsolve_cf_batch", backsolve_cf_batch, -1);
+  rb_define_module_function(mod, "backsolve_cf_packed", backsolve_cf_packed, -1);
+  rb_define_module_function(mod, "backsolve_irr_packed", backsolve_irr_packed, -1);
+  rb_define_module_function(mod, "xirr", xirr, -1);
+  rb_define_module_function(mod, "clear_solution_cache", clear_solution_cache, 0);
+
+  spread_cache = rb_hash_new();
+  irr_cache    = rb_hash_new();
+  rb_gc_register_address(&spread_cache);
+  rb_gc_register_address(&irr_cache);
+
+  rb_define_const(mod, "STATUS_OK",                 INT2FIX(0));
+  rb_define_const(mod, "STATUS_NO_SENSITIVITY",     INT2FIX((int)CH_NO_SENSITIVITY));
+  rb_define_const(mod, "STATUS_FAILED_TO_CONVERGE", INT2FIX((int)CH_FAILED_TO_CONVERGE));
+  rb_define_const(mod, "STATUS_NO_CASH_FLOWS",      INT2FIX((int)CH_NO_CASH_FLOWS));
+  rb_define_const(mod, "STATUS_INVALID_INPUT",      INT2FIX((int)CH_INVALID_INPUT));
+  rb_define_const(mod, "STATUS_NO_BRACKET",         INT2FIX((int)CH_NO_BRACKET));
+  rb_define_const(mod, "STATUS_NO_MEMORY",          INT2FIX((int)CH_NO_MEMORY));
+
+  result_class = rb_struct_define_under(mod, "Result", "value", "status", "iterations", "residual", NULL);
+  rb_define_method(result_class, "ok?", result_ok_p, 0);
+  risk_class = rb_struct_define_under(mod, "Risk", "value", "pv", "dpv", "d2pv", "modified_duration", "convexity", "dv01", NULL);
+
+  Init_curve(mod);
+  Init_calendar(mod);
+  Init_schedule(mod);
+  Init_cash_flow_stream(mod);
+  Init_compute_pv(mod);
+  Init_monte_carlo(mod);
+  Init_stats(mod);
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+#ifndef C_HELPER_H
+#define C_HELPER_H
+
+/* sentinel values returned by the internal functions in place of a spread or yield; the batch API reports them
+ * (as integers) in its status array, with 0 meaning the solve converged
+ */
+#define CH_NO_SENSITIVITY     -999.0  // value doesn't change when yield is sensitized
+#define CH_FAILED_TO_CONVERGE -998.0  // ran out of tries
+#define CH_NO_CASH_FLOWS      -997.0  // nothing to discount
+#define CH_INVALID_INPUT      -996.0  // batch only: mismatched array lengths or non-monotonic dates
+#define CH_INTERRUPTED        -995.0  // the calling Ruby thread was interrupted mid-solve; never reaches Ruby
+#define CH_NO_BRACKET         -994.0  // CH_BRENT only: f never changed sign, so there's no root to converge on
+#define CH_NO_MEMORY          -993.0  // a solver couldn't allocate its scratch space
+
+/* root-finding methods for _solve() */
+#define CH_SECANT 0
+#define CH_NEWTON 1
+#define CH_BRENT  2
+
+/* day-count conventions; see day_count.c */
+#define CH_ACT_365F     0
+#define CH_ACT_360      1
+#define CH_30_360       2
+#define CH_ACT_ACT_ISDA 3
+
+/* solver_opts
+ * how _solve() should iterate; see solver.c
+ */
+typedef struct {
+  int method;
+  double guess;  // where to start iterating; 0.06 unless the caller knows better
+  double res;
+  long max_tries;
+  volatile int *interrupted;  // may be NULL
+  int day_count;              // IRRs only: how the dates become year fractions; CH_ACT_365F unless asked
+  long iterations;            // out: how many iterations the last _solve() took
+  double residual;            // out: and f where it stopped
+} solver_opts;
+
+/* solver_stats
+ * counters behind CHelper.stats; see stats.c
+ */
+#define CH_ITERATION_BUCKETS 32  // histogram of iterations per solve: 0 to 30, then 31 or more
+
+typedef struct {
+  long solves, pv_evaluations;
+  long iterations[CH_ITERATION_BUCKETS];
+  long max_iterations;
+  long failed_to_converge, no_sensitivity, other_failures;
+  long marshal_ns, solve_ns;
+} solver_stats;
+
+/* the function _solve() finds a root of: returns f(x), and f'(x) in *deriv unless deriv is NULL */
+typedef double (*objective_fn)(void *data, double x, double *deriv);
+
+/* solver.c */
+double _compute_pv(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double spread);
+double _compute_pv_for_irr(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, int day_count, double irr);
+void _compute_pv_scenarios(double *cfs, double *dates, double *libor, double *shifts, long num_cfs, long num_scenarios, char is_clean, double accrued_interest, double year_convention, double *spreads, double *pvs);
+void _compute_pv_paths(double *cfs, double *dates, double *paths, long stride, long num_cfs, long num_paths, double year_convention, double spread, double *pvs, double *dpvs);
+void _compute_pv_multi(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double *spreads, long num_spreads, double *pvs);
+double _compute_pv_and_deriv(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double spread, double *dpv_dspread);
+void _irr_year_fractions(double *dates, long num_cfs, int day_count, double *year_fractions);
+double _compute_pv_for_irr_yf(double *cfs, double *year_fractions, long num_cfs, char is_clean, double accrued_interest, double irr, double *dpv_dirr);
+void _compute_pv_risk(double *cfs, double *dates, double *libor, long num_cfs, double year_convention, double spread, double *risk);
+void _compute_pv_for_irr_risk(double *cfs, double *dates, long num_cfs, int day_count, double irr, double *risk);
+double _solve(objective_fn f, void *data, double x_min, solver_opts *opts);
+double _backsolve_cf(double *cfs, double *dates, double *libor, long num_cfs, double target_px, char is_clean, double accrued_interest, double year_convention, solver_opts *opts);
+double _backsolve_irr(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, solver_opts *opts);
+long _irr_sign_changes(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest);
+double _irr_roots(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, double lower, double upper, long steps, solver_opts *opts, double *roots);
+double _backsolve_cf_scenarios(double *cfs, double *dates, double *libor, double *shifts, long num_cfs, long num_scenarios, double target_px, char is_clean, double accrued_interest, double year_convention, solver_opts *opts, double *results);
+void _count_solve(solver_stats *stats, double result, solver_opts *opts);
+
+/* day_count.c */
+void _civil_from_serial(long serial, long *year, long *month, long *day);
+long _serial_from_civil(long year, long month, long day);
+long _days_in_month(long year, long month);
+double _year_fraction(double from, double to, int day_count);
+void _year_fractions(double *dates, long num_dates, double origin, int day_count, double *year_fractions);
+double _accrual_dates(double *dates, long num_dates, double settle, int day_count, double *accrual_dates);
+
+/* business-day rolls for _adjust_date() */
+#define CH_UNADJUSTED         0
+#define CH_FOLLOWING          1
+#define CH_MODIFIED_FOLLOWING 2
+#define CH_PRECEDING          3
+#define CH_MODIFIED_PRECEDING 4
+
+/* ch_calendar
+ * the closed days behind a CHelper::Calendar; see calendar.c
+ */
+typedef struct {
+  long first_day, num_days;  // the span of the bitmap, in serial dates
+  unsigned char *closed;     // one bit per day of the span: set on holidays and weekend days
+  int weekend;               // bit d set if day d of the week (0 is Sunday) is a weekend day; -1 until initialized
+} ch_calendar;
+
+/* calendar.c */
+int _is_business_day(ch_calendar *calendar, long serial);
+long _adjust_date(ch_calendar *calendar, long serial, int roll);
+void _adjust_dates(ch_calendar *calendar, double *dates, long num_dates, int roll, double *adjusted);
+long _advance_date(ch_calendar *calendar, long serial, long num_days);
+
+/* stubs for ch_schedule_rules */
+#define CH_SHORT_FRONT 0
+#define CH_LONG_FRONT  1
+#define CH_SHORT_BACK  2
+#define CH_LONG_BACK   3
+
+/* ch_schedule_rules
+ * how _schedule() lays out and adjusts a coupon schedule; see schedule.c
+ */
+typedef struct {
+  int stub;
+  char end_of_month;
+  ch_calendar *calendar;  // may be NULL, to leave the dates unadjusted
+  int roll;
+  int day_count;          // for the year fractions
+} ch_schedule_rules;
+
+/* schedule.c */
+long _schedule_max_periods(long effective, long termination, long frequency);
+long _schedule(ch_schedule_rules *rules, long effective, long termination, long frequency, double *dates, double *year_fractions);
+
+/* interpolation methods for a ch_curve */
+#define CH_LINEAR         0
+#define CH_LOG_LINEAR_DF  1
+#define CH_MONOTONE_CUBIC 2
+
+/* ch_curve
+ * the pillars behind a CHelper::Curve; see curve.c
+ */
+typedef struct {
+  double *dates, *rates, *slopes;  // slopes is only used by CH_MONOTONE_CUBIC
+  long num_pillars;
+  int interpolation;
+} ch_curve;
+
+/* curve.c */
+void _curve_rates(ch_curve *curve, double *dates, long num_dates, double *rates);
+
+/* amortization types for ch_loan_terms */
+#define CH_LEVEL_PAY     0
+#define CH_STRAIGHT_LINE 1
+#define CH_BULLET        2
+#define CH_CUSTOM_AMORT  3
+
+/* ch_loan_terms
+ * what _amortize() builds a schedule from; see amortization.c
+ */
+typedef struct {
+  int amortization;
+  double balance;       // at origination
+  double coupon;        // annual; the margin over libor when libor isn't NULL
+  long num_periods, frequency, io_periods;  // frequency is payments per year; io_periods are at the start
+  double *libor;        // NULL for a fixed coupon, otherwise one per period
+  double *amort_table;  // CH_CUSTOM_AMORT only: scheduled principal for each period
+} ch_loan_terms;
+
+/* prepayment models for _smm_vector() */
+#define CH_CPR 0
+#define CH_PSA 1
+
+/* amortization.c */
+void _payment_dates(double first_date, long frequency, long num_periods, double *dates);
+void _amortize(ch_loan_terms *terms, double *balances, double *interest, double *principal, double *cfs);
+void _smm_vector(int model, double speed, long frequency, long age, long num_periods, double *smm);
+void _apply_prepayments(double *smm, long num_periods, double *balances, double *interest, double *principal, double *cfs);
+void _periodic_rates(double *annual_rates, long frequency, long num_periods, double *rates);
+void _apply_defaults(double *mdr, long num_periods, double severity, long lag, double *balances, double *interest, double *principal, double *recoveries, double *losses, double *cfs);
+
+/* short-rate models for _rate_model() */
+#define CH_HULL_WHITE 0
+#define CH_VASICEK    1
+
+#define CH_MAX_THREADS 64  // the most threads _parallel_for() will split work across
+
+/* ch_rate_model
+ * a one-factor short-rate model discretized on a loan's dates, r = drift + x with x stepped as
+ * x[t] = x[t - 1] * decay[t] + stdev[t] * z; see _rate_model() in monte_carlo.c
+ */
+typedef struct {
+  double *drift, *decay, *stdev;
+  long num_periods;
+  unsigned long long seed;
+} ch_rate_model;
+
+/* monte_carlo.c */
+void _rate_model(int model, double *dates, double *forwards, long num_periods, double a, double sigma, double mean, double year_convention, ch_rate_model *rate_model);
+void _rate_path(ch_rate_model *rate_model, long path, double *rates);
+void _parallel_for(long n, int num_threads, void (*fn)(void *ctx, long begin, long end), void *ctx);
+int _default_threads(void);
+double _backsolve_oas(double *cfs, double *dates, double *paths, long num_cfs, long num_paths, double target_px, char is_clean, double accrued_interest, double year_convention, int num_threads, double *scratch, solver_opts *opts);
+
+/* Ruby glue shared between the exported-function files; solver.c doesn't include ruby.h, so it never sees these */
+#ifdef RUBY_RUBY_H
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+#include <ruby/memory_view.h>
+#endif
+
+/* double_buffer
+ * a view of the doubles held by a packed String or MemoryView exporter (or converted from an Array); see
+ * _get_double_buffer() in double_buffer.c
+ */
+typedef struct {
+  double *ptr;
+  long len;
+  VALUE holder;  // the object that owns ptr, kept on the stack so GC neither frees nor moves it while we solve
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  char has_view;
+  rb_memory_view_t view;
+#endif
+} double_buffer;
+
+#define DOUBLE_BUFFER_INIT {0}
+
+/* double_buffer.c */
+double *_alloc_doubles(long len, VALUE *holder);
+const char *_get_double_buffer(VALUE obj, double_buffer *buf);
+void _release_double_buffer(double_buffer *buf);
+
+/* solve_job
+ * everything the solvers need once the inputs have been copied out of Ruby, so that the solve can run without the GVL;
+ * loans sit back to back in the cfs/dates/libor buffers (a single backsolve is just a job with one loan), and libor is
+ * NULL for IRR solves
+ *
+ * results[i] starts out as a sentinel for a loan that failed validation (the solve skips it) and as 0.0 otherwise;
+ * which loans are done is tracked by next_loan alone, never by the values in results
+ */
+typedef struct {
+  double *cfs, *dates, *libor;
+  long *num_cfs;
+  double *target_px, *accrued_interest, *results;
+  long num_loans;
+  char is_clean;
+  double year_convention;
+  solver_opts opts;  // opts.interrupted is pointed at interrupted by _solve_without_gvl()
+  double *guesses;   // per-loan starting points overriding opts.guess; may be NULL
+  double *risk;      // may be NULL; otherwise 3 per loan, filled in for loans that converge (see _compute_pv_risk())
+
+  long next_loan, next_offset;  // where to pick up again after an interrupt
+  volatile int interrupted;
+  solver_stats stats;
+} solve_job;
+
+/* which solution cache, if any, a solve's loan_id: option refers to; see _get_solver_opts() */
+#define NO_CACHE     0
+#define SPREAD_CACHE 1
+#define IRR_CACHE    2
+
+/* backsolve_cf.c */
+VALUE _split_kwargs(int *argc, VALUE *argv, int num_positional);
+int _solve_without_gvl(solve_job *job, long started_ns);
+int _get_day_count(VALUE day_count);
+solver_opts _get_solver_opts(VALUE res, VALUE max_tries, VALUE kwargs, int cache);
+void _remember_solution(VALUE kwargs, int cache, double c_result);
+int _status_of(double result);
+VALUE _result_or_raise(double c_result);
+VALUE _solver_result(VALUE kwargs, double c_result, solver_opts *opts, double *risk);
+int _wants_risk(VALUE kwargs);
+void _get_packed_inputs(VALUE cfs, VALUE dates, VALUE libor, double_buffer *bufs[3], char strict_dates);
+long _batch_total_cfs(VALUE cfs_list, VALUE dates_list, VALUE libor_list, ch_curve *shared_curve);
+double _pack_loan(VALUE cfs_list, VALUE dates_list, VALUE libor_list, ch_curve *shared_curve, long i, double *cfs, double *dates, double *libor);
+
+/* stats.c */
+long _clock_ns(void);
+void _record_stats(solver_stats *stats, long started_ns, long solve_started_ns, long solve_finished_ns);
+void Init_stats(VALUE mod);
+
+/* curve.c */
+ch_curve *_get_curve(VALUE obj);
+const char *_get_libor_buffer(VALUE libor, double *dates, long num_cfs, double_buffer *buf);
+void Init_curve(VALUE mod);
+
+/* calendar.c */
+ch_calendar *_get_calendar(VALUE obj);
+int _get_roll(VALUE roll);
+void Init_calendar(VALUE mod);
+
+/* cash_flow_stream.c */
+void Init_cash_flow_stream(VALUE mod);
+
+/* compute_pv.c */
+void Init_compute_pv(VALUE mod);
+
+/* monte_carlo.c */
+int _get_threads(VALUE threads);
+void Init_monte_carlo(VALUE mod);
+
+/* schedule.c */
+void Init_schedule(VALUE mod);
+#endif
+
+#endif
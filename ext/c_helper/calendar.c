@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <math.h>
+#include <ruby.h>
+#include "c_helper.h"
+
+/* calendar.c
+ * CHelper::Calendar, a business-day calendar held in native memory: a bitmap of the days the market is closed (its
+ * holidays, with the weekend days folded in) over the span of the holidays, and a weekend mask for dates outside that
+ * span. Dates are serials, as in day_count.c, and rolling one is a bit test per day tried, so whole schedules can be
+ * adjusted natively with no Date per date
+ */
+
+#define MAX_CALENDAR_DAYS (400L * 366L)  // a holiday list spanning more than this is surely a mistake
+
+
+
+/* _weekday()
+ * internal function that gives the day of the week of a serial date, numbered as Date#wday does (0 is Sunday); day 0
+ * of the Julian Day Numbers was a Monday
+ */
+static int _weekday(long serial) {
+  return (int)(((serial + 1) % 7 + 7) % 7);
+}
+
+
+/* _is_business_day()
+ * internal function that says whether calendar is open on a serial date; outside the span of its holidays, only the
+ * weekend counts as closed
+ */
+int _is_business_day(ch_calendar *calendar, long serial) {
+  long k = serial - calendar->first_day;
+
+  if (k >= 0 && k < calendar->num_days)
+    return !(calendar->closed[k >> 3] & (1 << (k & 7)));
+  return !(calendar->weekend & (1 << _weekday(serial)));
+}
+
+
+static int _same_month(long a, long b) {
+  long ya, ma, yb, mb, d;
+
+  _civil_from_serial(a, &ya, &ma, &d);
+  _civil_from_serial(b, &yb, &mb, &d);
+  return ya == yb && ma == mb;
+}
+
+
+/* _adjust_date()
+ * internal function that rolls a serial date onto a business day under roll:
+ *  - CH_FOLLOWING / CH_PRECEDING take the first business day on or after / on or before it
+ *  - CH_MODIFIED_FOLLOWING / CH_MODIFIED_PRECEDING do the same unless that crosses into another month, in which case
+ *    they go the other way instead
+ *  - CH_UNADJUSTED leaves it be
+ *
+ * assumes that the calendar has at least one business day a week (Calendar#initialize sees to that)
+ */
+long _adjust_date(ch_calendar *calendar, long serial, int roll) {
+  long adjusted = serial;
+
+  switch (roll) {
+    case CH_FOLLOWING:
+    case CH_MODIFIED_FOLLOWING:
+      while (!_is_business_day(calendar, adjusted))
+        adjusted++;
+      if (roll == CH_MODIFIED_FOLLOWING && !_same_month(adjusted, serial))
+        return _adjust_date(calendar, serial, CH_PRECEDING);
+      return adjusted;
+    case CH_PRECEDING:
+    case CH_MODIFIED_PRECEDING:
+      while (!_is_business_day(calendar, adjusted))
+        adjusted--;
+      if (roll == CH_MODIFIED_PRECEDING && !_same_month(adjusted, serial))
+        return _adjust_date(calendar, serial, CH_FOLLOWING);
+      return adjusted;
+    default:
+      return serial;
+  }
+}
+
+
+/* _adjust_dates()
+ * internal function that rolls each of num_dates serial dates (doubles, of which only the whole-day part is looked at)
+ * with _adjust_date() into adjusted, which may be dates itself
+ */
+void _adjust_dates(ch_calendar *calendar, double *dates, long num_dates, int roll, double *adjusted) {
+  long t;
+
+  for (t = 0; t < num_dates; t++)
+    adjusted[t] = (double)_adjust_date(calendar, (long)floor(dates[t]), roll);
+}
+
+
+/* _advance_date()
+ * internal function that moves a serial date num_days business days forward (or back, if num_days is negative); with
+ * num_days 0, it's the date rolled to the following business day
+ */
+long _advance_date(ch_calendar *calendar, long serial, long num_days) {
+  long step = num_days < 0 ? -1 : 1, remaining = labs(num_days);
+
+  serial = _adjust_date(calendar, serial, num_days < 0 ? CH_PRECEDING : CH_FOLLOWING);
+  while (remaining > 0) {
+    serial += step;
+    if (_is_business_day(calendar, serial))
+      remaining--;
+  }
+  return serial;
+}
+
+
+static void _calendar_free(void *ptr) {
+  ch_calendar *calendar = (ch_calendar *)ptr;
+  free(calendar->closed);
+  free(calendar);
+}
+
+static size_t _calendar_memsize(const void *ptr) {
+  const ch_calendar *calendar = (const ch_calendar *)ptr;
+  return sizeof(*calendar) + (calendar->num_days + 7) / 8;
+}
+
+static const rb_data_type_t calendar_type = {
+  "CHelper::Calendar",
+  { NULL, _calendar_free, _calendar_memsize, },
+  NULL, NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+
+static VALUE calendar_alloc(VALUE klass) {
+  ch_calendar *calendar;
+  VALUE obj = TypedData_Make_Struct(klass, ch_calendar, &calendar_type, calendar);
+  calendar->weekend = -1;  // not initialized yet
+  return obj;
+}
+
+
+/* _get_calendar()
+ * internal function that unwraps a Calendar, or returns NULL if obj isn't one; raises if it was never initialized
+ */
+ch_calendar *_get_calendar(VALUE obj) {
+  ch_calendar *calendar;
+
+  if (!rb_typeddata_is_kind_of(obj, &calendar_type))
+    return NULL;
+  calendar = RTYPEDDATA_DATA(obj);
+  if (calendar->weekend < 0)
+    rb_raise(rb_eRuntimeError, "uninitialized Calendar");
+  return calendar;
+}
+
+
+/* _get_roll()
+ * internal function that maps a roll argument to its convention for _adjust_date(): :following, :modified_following,
+ * :preceding, :modified_preceding or :unadjusted; nil is :following
+ */
+int _get_roll(VALUE roll) {
+  if (NIL_P(roll) || roll == ID2SYM(rb_intern("following")))
+    return CH_FOLLOWING;
+  else if (roll == ID2SYM(rb_intern("modified_following")))
+    return CH_MODIFIED_FOLLOWING;
+  else if (roll == ID2SYM(rb_intern("preceding")))
+    return CH_PRECEDING;
+  else if (roll == ID2SYM(rb_intern("modified_preceding")))
+    return CH_MODIFIED_PRECEDING;
+  else if (roll == ID2SYM(rb_intern("unadjusted")))
+    return CH_UNADJUSTED;
+
+  rb_raise(rb_eArgError, "unknown roll %"PRIsVALUE" (expected :following, :modified_following, :preceding, :modified_preceding or :unadjusted)", roll);
+  return CH_FOLLOWING;
+}
+
+
+/* Calendar#initialize(holidays = [], weekend: [0, 6])
+ * builds the bitmap from holidays, serial dates (Date#jd) as an Array or a packed buffer of doubles, in any order;
+ * weekend is the days of the week the market is always closed, numbered as Date#wday does (Saturday and Sunday by
+ * default)
+ *
+ * a Calendar can't be re-initialized: schedule_batch reads the bitmap without the GVL, so it must not be freed while
+ * the Calendar is alive
+ */
+static VALUE calendar_initialize(int argc, VALUE *argv, VALUE self) {
+  VALUE holidays, kwargs, weekend = Qundef;
+  ID kw_keys[1];
+  ch_calendar *calendar;
+  TypedData_Get_Struct(self, ch_calendar, &calendar_type, calendar);
+  if (calendar->weekend >= 0)
+    rb_raise(rb_eRuntimeError, "Calendar is already initialized");
+
+  rb_scan_args(argc, argv, "01:", &holidays, &kwargs);
+  if (!NIL_P(kwargs)) {
+    kw_keys[0] = rb_intern("weekend");
+    rb_get_kwargs(kwargs, kw_keys, 0, 1, &weekend);
+  }
+
+  int c_weekend = (1 << 0) | (1 << 6);
+  long i;
+  if (weekend != Qundef && !NIL_P(weekend)) {
+    Check_Type(weekend, T_ARRAY);
+    c_weekend = 0;
+    for (i = 0; i < RARRAY_LEN(weekend); i++) {
+      long wday = NUM2LONG(rb_ary_entry(weekend, i));
+      if (wday < 0 || wday > 6)
+        rb_raise(rb_eArgError, "weekend days must be 0 (Sunday) to 6 (Saturday), as Date#wday gives them");
+      c_weekend |= 1 << wday;
+    }
+    if (c_weekend == 0x7f)
+      rb_raise(rb_eArgError, "a calendar needs at least one business day a week");
+  }
+
+  double_buffer c_holidays = DOUBLE_BUFFER_INIT;
+  const char *err = NULL;
+  long first_day = 0, last_day = -1, serial, k;
+
+  if (!NIL_P(holidays) && (err = _get_double_buffer(holidays, &c_holidays)) != NULL) {
+    _release_double_buffer(&c_holidays);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  for (i = 0; i < c_holidays.len; i++) {
+    serial = (long)floor(c_holidays.ptr[i]);
+    if (i == 0 || serial < first_day) first_day = serial;
+    if (i == 0 || serial > last_day)  last_day = serial;
+  }
+  if (last_day - first_day >= MAX_CALENDAR_DAYS) {
+    _release_double_buffer(&c_holidays);
+    rb_raise(rb_eArgError, "holidays span more than %ld days", MAX_CALENDAR_DAYS);
+  }
+
+  long num_days = last_day - first_day + 1;
+  unsigned char *closed = calloc((num_days + 7) / 8 + 1, 1);
+  if (closed == NULL) {
+    _release_double_buffer(&c_holidays);
+    rb_raise(rb_eNoMemError, "failed to allocate memory for Calendar");
+  }
+
+  // the weekends first, so the bitmap alone answers for any date in the span
+  for (k = 0; k < num_days; k++)
+    if (c_weekend & (1 << _weekday(first_day + k)))
+      closed[k >> 3] |= 1 << (k & 7);
+  for (i = 0; i < c_holidays.len; i++) {
+    k = (long)floor(c_holidays.ptr[i]) - first_day;
+    closed[k >> 3] |= 1 << (k & 7);
+  }
+  _release_double_buffer(&c_holidays);
+
+  calendar->first_day = first_day;
+  calendar->num_days = num_days;
+  calendar->closed = closed;
+  calendar->weekend = c_weekend;
+  return self;
+}
+
+
+/* Calendar#business_day?(date)
+ */
+static VALUE calendar_business_day_p(VALUE self, VALUE date) {
+  return _is_business_day(_get_calendar(self), NUM2LONG(date)) ? Qtrue : Qfalse;
+}
+
+
+/* Calendar#adjust(date, roll = :following)
+ * date rolled onto a business day; see _get_roll() for the rolls
+ */
+static VALUE calendar_adjust(int argc, VALUE *argv, VALUE self) {
+  VALUE date, roll;
+  rb_scan_args(argc, argv, "11", &date, &roll);
+  ch_calendar *calendar = _get_calendar(self);
+  return LONG2NUM(_adjust_date(calendar, NUM2LONG(date), _get_roll(roll)));
+}
+
+
+/* Calendar#adjust_dates(dates, roll = :following)
+ * each of dates (an Array, or a packed buffer of doubles) rolled onto a business day, returned as a packed String of
+ * doubles, ready to pass along as the dates of a cash-flow stream
+ */
+static VALUE calendar_adjust_dates(int argc, VALUE *argv, VALUE self) {
+  VALUE dates, roll, adjusted_holder;
+  rb_scan_args(argc, argv, "11", &dates, &roll);
+  ch_calendar *calendar = _get_calendar(self);
+  int c_roll = _get_roll(roll);
+
+  double_buffer c_dates = DOUBLE_BUFFER_INIT;
+  const char *err;
+
+  if ((err = _get_double_buffer(dates, &c_dates)) != NULL) {
+    _release_double_buffer(&c_dates);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  double *adjusted = _alloc_doubles(c_dates.len, &adjusted_holder);
+  _adjust_dates(calendar, c_dates.ptr, c_dates.len, c_roll, adjusted);
+  VALUE result = rb_str_new((const char *)adjusted, c_dates.len * sizeof(double));
+
+  _release_double_buffer(&c_dates);
+  RB_GC_GUARD(adjusted_holder);
+  return result;
+}
+
+
+/* Calendar#advance(date, num_days)
+ * the date num_days business days after date (before, if num_days is negative), e.g. a T+2 settlement date
+ */
+static VALUE calendar_advance(VALUE self, VALUE date, VALUE num_days) {
+  return LONG2NUM(_advance_date(_get_calendar(self), NUM2LONG(date), NUM2LONG(num_days)));
+}
+
+
+void Init_calendar(VALUE mod) {
+  VALUE klass = rb_define_class_under(mod, "Calendar", rb_cObject);
+  rb_define_alloc_func(klass, calendar_alloc);
+  rb_define_method(klass, "initialize", calendar_initialize, -1);
+  rb_define_method(klass, "business_day?", calendar_business_day_p, 1);
+  rb_define_method(klass, "adjust", calendar_adjust, -1);
+  rb_define_method(klass, "adjust_dates", calendar_adjust_dates, -1);
+  rb_define_method(klass, "advance", calendar_advance, 2);
+}
\ No newline at end of file
@@ -0,0 +1,626 @@
+#include <string.h>
+#include <ruby.h>
+#include "c_helper.h"
+
+/* cash_flow_stream.c
+ * CHelper::CashFlowStream, a loan's cash flows and dates converted and validated once and then kept in native memory,
+ * for when the same stream gets solved over and over against different target prices and libor sets; a stream can
+ * also be generated natively from the loan's terms (see CashFlowStream.amortizing), with no Ruby Arrays in between
+ */
+
+
+
+typedef struct {
+  double *cfs, *dates;
+  long num_cfs;
+  char strictly_increasing;  // dates are > 0 and strictly increasing, as backsolve_cf needs; IRRs only need non-decreasing
+  double *balances, *interest, *principal;  // streams from CashFlowStream.amortizing only, otherwise NULL
+  double *recoveries, *losses;              // ditto; all zero until default! is run
+  char defaulted;                           // default! has been run, so prepay! can't be
+  long frequency;                           // ditto: payments per year
+  int solving;                              // how many solves are running on the buffers without the GVL
+} cash_flow_stream;
+
+
+static void _cash_flow_stream_free(void *ptr) {
+  cash_flow_stream *stream = (cash_flow_stream *)ptr;
+  free(stream->cfs);
+  free(stream->dates);
+  free(stream->balances);  // interest, principal, recoveries and losses share the allocation
+  free(stream);
+}
+
+static size_t _cash_flow_stream_memsize(const void *ptr) {
+  const cash_flow_stream *stream = (const cash_flow_stream *)ptr;
+  return sizeof(*stream) + (stream->balances != NULL ? 7 : 2) * stream->num_cfs * sizeof(double);
+}
+
+static const rb_data_type_t cash_flow_stream_type = {
+  "CHelper::CashFlowStream",
+  { NULL, _cash_flow_stream_free, _cash_flow_stream_memsize, },
+  NULL, NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+
+static VALUE cash_flow_stream_alloc(VALUE klass) {
+  cash_flow_stream *stream;
+  return TypedData_Make_Struct(klass, cash_flow_stream, &cash_flow_stream_type, stream);
+}
+
+
+/* _get_cash_flow_stream()
+ * internal function that unwraps a CashFlowStream, raising if it was never initialized
+ */
+static cash_flow_stream *_get_cash_flow_stream(VALUE self) {
+  cash_flow_stream *stream;
+  TypedData_Get_Struct(self, cash_flow_stream, &cash_flow_stream_type, stream);
+  if (stream->cfs == NULL)
+    rb_raise(rb_eRuntimeError, "uninitialized CashFlowStream");
+  return stream;
+}
+
+
+/* _check_not_solving()
+ * internal function for anything that rewrites or frees a stream's buffers: raises if a solve_spread or solve_irr on
+ * another thread is still reading them without the GVL. Call it right before the buffers are touched, after any
+ * conversion that could run Ruby code (and so let a solve start)
+ */
+#define CH_STREAM_SOLVING "can't change a CashFlowStream while it's being solved"
+
+static void _check_not_solving(cash_flow_stream *stream) {
+  if (stream->solving > 0)
+    rb_raise(rb_eRuntimeError, CH_STREAM_SOLVING);
+}
+
+
+/* CashFlowStream#initialize(cfs, dates)
+ * copies cfs and dates (Arrays, or packed buffers of doubles) into native memory and checks the dates once, so that
+ * later solves don't have to
+ *
+ * dates must be non-decreasing, as backsolve_irr requires; solve_spread additionally requires them to start at a value
+ * > 0 and be strictly increasing, as backsolve_cf does, and raises if they aren't
+ */
+static VALUE cash_flow_stream_initialize(VALUE self, VALUE cfs, VALUE dates) {
+  cash_flow_stream *stream;
+  TypedData_Get_Struct(self, cash_flow_stream, &cash_flow_stream_type, stream);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT;
+  const char *err;
+  long i;
+
+  if ((err = _get_double_buffer(cfs, &c_cfs)) != NULL || (err = _get_double_buffer(dates, &c_dates)) != NULL) {
+    _release_double_buffer(&c_cfs);
+    _release_double_buffer(&c_dates);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  if (c_cfs.len < 1)
+    err = "valid array of cash flows must have at least one entry";
+  else if (c_dates.len != c_cfs.len)
+    err = "cfs and dates must have the same number of entries";
+  for (i = 1; err == NULL && i < c_dates.len; i++)
+    if (c_dates.ptr[i] < c_dates.ptr[i - 1])
+      err = "dates must contain a list of monotonically increasing values, starting at a value > 0";
+  if (err == NULL && stream->solving > 0)
+    err = CH_STREAM_SOLVING;
+
+  if (err == NULL) {
+    // re-initializing replaces the old buffers
+    free(stream->cfs);
+    free(stream->dates);
+    free(stream->balances);
+    stream->balances = stream->interest = stream->principal = stream->recoveries = stream->losses = NULL;
+    stream->num_cfs = 0;
+    stream->cfs   = malloc(c_cfs.len * sizeof(double));
+    stream->dates = malloc(c_cfs.len * sizeof(double));
+    if (stream->cfs == NULL || stream->dates == NULL) {
+      free(stream->cfs); free(stream->dates);
+      stream->cfs = stream->dates = NULL;
+      _release_double_buffer(&c_cfs);
+      _release_double_buffer(&c_dates);
+      rb_raise(rb_eNoMemError, "failed to allocate memory for CashFlowStream");
+    }
+
+    memcpy(stream->cfs,   c_cfs.ptr,   c_cfs.len * sizeof(double));
+    memcpy(stream->dates, c_dates.ptr, c_cfs.len * sizeof(double));
+    stream->num_cfs = c_cfs.len;
+    stream->strictly_increasing = c_dates.ptr[0] > 0.0;
+    for (i = 1; stream->strictly_increasing && i < c_dates.len; i++)
+      stream->strictly_increasing = c_dates.ptr[i] > c_dates.ptr[i - 1];
+  }
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+
+  if (err != NULL)
+    rb_raise(rb_eRuntimeError, "%s", err);
+
+  return self;
+}
+
+
+static VALUE cash_flow_stream_size(VALUE self) {
+  return LONG2NUM(_get_cash_flow_stream(self)->num_cfs);
+}
+
+
+/* CashFlowStream.amortizing(balance, coupon, num_periods, frequency, type = :level_pay, io_periods: 0,
+ *                           amortization: nil, libor: nil, first_date: 365.0 / frequency)
+ * generates a loan's schedule natively (see _amortize()) and returns it as a CashFlowStream, ready to solve with no
+ * Ruby Arrays built along the way; type is :level_pay, :straight_line, :bullet or :custom, which pays the principal
+ * in amortization: (an Array or packed buffer, one entry per period)
+ *
+ * payments are frequency times a year, the first first_date days out. coupon is annual; with libor: (an Array, a
+ * packed buffer or a CHelper::Curve, read at the payment dates) the loan floats and coupon is its margin
+ */
+static VALUE cash_flow_stream_s_amortizing(int argc, VALUE *argv, VALUE klass) {
+  VALUE balance, coupon, num_periods, frequency, type, kwargs;
+  VALUE kw_values[4] = { Qundef, Qundef, Qundef, Qundef };
+  ID kw_ids[4];
+
+  rb_scan_args(argc, argv, "41:", &balance, &coupon, &num_periods, &frequency, &type, &kwargs);
+  Check_Type(balance,           T_FLOAT);
+  Check_Type(coupon,            T_FLOAT);
+  Check_Type(num_periods,       T_FIXNUM);
+  Check_Type(frequency,         T_FIXNUM);
+  if (!NIL_P(kwargs)) {
+    kw_ids[0] = rb_intern("io_periods");
+    kw_ids[1] = rb_intern("amortization");
+    kw_ids[2] = rb_intern("libor");
+    kw_ids[3] = rb_intern("first_date");
+    rb_get_kwargs(kwargs, kw_ids, 0, 4, kw_values);
+  }
+
+  ch_loan_terms terms = { CH_LEVEL_PAY, NUM2DBL(balance), NUM2DBL(coupon), NUM2LONG(num_periods), NUM2LONG(frequency), 0 };
+  if (NIL_P(type) || type == ID2SYM(rb_intern("level_pay")))
+    terms.amortization = CH_LEVEL_PAY;
+  else if (type == ID2SYM(rb_intern("straight_line")))
+    terms.amortization = CH_STRAIGHT_LINE;
+  else if (type == ID2SYM(rb_intern("bullet")))
+    terms.amortization = CH_BULLET;
+  else if (type == ID2SYM(rb_intern("custom")))
+    terms.amortization = CH_CUSTOM_AMORT;
+  else
+    rb_raise(rb_eArgError, "unknown amortization type %"PRIsVALUE" (expected :level_pay, :straight_line, :bullet or :custom)", type);
+
+  if (kw_values[0] != Qundef) {
+    Check_Type(kw_values[0], T_FIXNUM);
+    terms.io_periods = NUM2LONG(kw_values[0]);
+  }
+  if (terms.num_periods < 1 || terms.frequency < 1)
+    rb_raise(rb_eArgError, "num_periods and frequency must be > 0");
+  if (terms.io_periods < 0 || terms.io_periods > terms.num_periods)
+    rb_raise(rb_eArgError, "io_periods must be between 0 and num_periods");
+  if ((terms.amortization == CH_CUSTOM_AMORT) != (kw_values[1] != Qundef && !NIL_P(kw_values[1])))
+    rb_raise(rb_eArgError, "amortization: is required for :custom, and only for :custom");
+
+  double first_date = 365.0 / terms.frequency;
+  if (kw_values[3] != Qundef) {
+    Check_Type(kw_values[3], T_FLOAT);
+    first_date = NUM2DBL(kw_values[3]);
+  }
+  if (first_date <= 0.0)
+    rb_raise(rb_eArgError, "first_date must be > 0");
+
+  // the buffers belong to the stream from the start, so GC takes care of them if anything below raises
+  cash_flow_stream *stream;
+  VALUE self = TypedData_Make_Struct(klass, cash_flow_stream, &cash_flow_stream_type, stream);
+  long n = terms.num_periods;
+  stream->cfs      = malloc(n * sizeof(double));
+  stream->dates    = malloc(n * sizeof(double));
+  stream->balances = calloc(5 * n, sizeof(double));
+  if (stream->cfs == NULL || stream->dates == NULL || stream->balances == NULL)
+    rb_raise(rb_eNoMemError, "failed to allocate memory for CashFlowStream");
+  stream->interest   = stream->balances + n;
+  stream->principal  = stream->balances + 2 * n;
+  stream->recoveries = stream->balances + 3 * n;
+  stream->losses     = stream->balances + 4 * n;
+  _payment_dates(first_date, terms.frequency, n, stream->dates);
+
+  double_buffer c_table = DOUBLE_BUFFER_INIT, c_libor = DOUBLE_BUFFER_INIT;
+  const char *err = NULL;
+  if (terms.amortization == CH_CUSTOM_AMORT && (err = _get_double_buffer(kw_values[1], &c_table)) == NULL && c_table.len != n)
+    err = "amortization must have one entry per period";
+  if (err == NULL && kw_values[2] != Qundef && !NIL_P(kw_values[2]) &&
+      (err = _get_libor_buffer(kw_values[2], stream->dates, n, &c_libor)) == NULL && c_libor.len != n)
+    err = "libor must have one entry per period";
+  if (err != NULL) {
+    _release_double_buffer(&c_table);
+    _release_double_buffer(&c_libor);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  terms.amort_table = c_table.ptr;
+  terms.libor       = c_libor.ptr;
+  _amortize(&terms, stream->balances, stream->interest, stream->principal, stream->cfs);
+  stream->num_cfs = n;
+  stream->frequency = terms.frequency;
+  stream->strictly_increasing = 1;
+
+  _release_double_buffer(&c_table);
+  _release_double_buffer(&c_libor);
+  return self;
+}
+
+
+/* CashFlowStream#initialize_copy(other)
+ * copies other's buffers, so that dup gives a stream that can be changed (e.g. by prepay!) without touching the
+ * original
+ */
+static VALUE cash_flow_stream_initialize_copy(VALUE self, VALUE other) {
+  cash_flow_stream *stream, *source = _get_cash_flow_stream(other);
+  long n = source->num_cfs;
+  TypedData_Get_Struct(self, cash_flow_stream, &cash_flow_stream_type, stream);
+
+  if (stream == source)
+    return self;
+  _check_not_solving(stream);
+
+  free(stream->cfs);
+  free(stream->dates);
+  free(stream->balances);
+  *stream = *source;
+  stream->solving = 0;  // the source's solves aren't ours
+  stream->cfs      = malloc(n * sizeof(double));
+  stream->dates    = malloc(n * sizeof(double));
+  stream->balances = source->balances != NULL ? malloc(5 * n * sizeof(double)) : NULL;
+  stream->interest = stream->principal = stream->recoveries = stream->losses = NULL;
+  if (stream->cfs == NULL || stream->dates == NULL || (source->balances != NULL && stream->balances == NULL)) {
+    free(stream->cfs); free(stream->dates); free(stream->balances);
+    stream->cfs = stream->dates = stream->balances = NULL;
+    stream->num_cfs = 0;
+    rb_raise(rb_eNoMemError, "failed to allocate memory for CashFlowStream");
+  }
+
+  memcpy(stream->cfs,   source->cfs,   n * sizeof(double));
+  memcpy(stream->dates, source->dates, n * sizeof(double));
+  if (stream->balances != NULL) {
+    memcpy(stream->balances, source->balances, 5 * n * sizeof(double));  // the rest of the schedule follows balances
+    stream->interest   = stream->balances + n;
+    stream->principal  = stream->balances + 2 * n;
+    stream->recoveries = stream->balances + 3 * n;
+    stream->losses     = stream->balances + 4 * n;
+  }
+  return self;
+}
+
+
+/* CashFlowStream#prepay!(cpr: nil, psa: nil, smm: nil, age: 0)
+ * runs prepayments through an amortizing stream's schedule in place (see _apply_prepayments()), at a constant annual
+ * rate (cpr: 0.06), a PSA speed (psa: 150.0, with the loan age: months old at the start of the first period) or an
+ * SMM per period (smm:, an Array or a packed buffer); exactly one of them must be given. Returns self
+ *
+ * the prepayments are applied to the schedule as it stands, so to price under several speeds, prepay a dup of the
+ * scheduled stream for each
+ */
+static VALUE cash_flow_stream_prepay_bang(int argc, VALUE *argv, VALUE self) {
+  VALUE kwargs;
+  VALUE kw_values[4] = { Qundef, Qundef, Qundef, Qundef };
+  ID kw_ids[4];
+
+  rb_scan_args(argc, argv, ":", &kwargs);
+  if (!NIL_P(kwargs)) {
+    kw_ids[0] = rb_intern("cpr");
+    kw_ids[1] = rb_intern("psa");
+    kw_ids[2] = rb_intern("smm");
+    kw_ids[3] = rb_intern("age");
+    rb_get_kwargs(kwargs, kw_ids, 0, 4, kw_values);
+  }
+  if ((kw_values[0] != Qundef) + (kw_values[1] != Qundef) + (kw_values[2] != Qundef) != 1)
+    rb_raise(rb_eArgError, "exactly one of cpr:, psa: and smm: must be given");
+  if (kw_values[0] != Qundef) Check_Type(kw_values[0], T_FLOAT);
+  if (kw_values[1] != Qundef) Check_Type(kw_values[1], T_FLOAT);
+  if (kw_values[3] != Qundef) Check_Type(kw_values[3], T_FIXNUM);
+  // written so that NaN fails too
+  if (kw_values[0] != Qundef && !(NUM2DBL(kw_values[0]) >= 0.0 && NUM2DBL(kw_values[0]) <= 1.0))
+    rb_raise(rb_eArgError, "cpr must be between 0.0 and 1.0");
+  if (kw_values[1] != Qundef && !(NUM2DBL(kw_values[1]) >= 0.0))
+    rb_raise(rb_eArgError, "psa must be >= 0.0");
+  if (kw_values[3] != Qundef && NUM2LONG(kw_values[3]) < 0)
+    rb_raise(rb_eArgError, "age must be >= 0");
+
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  if (stream->balances == NULL)
+    rb_raise(rb_eRuntimeError, "only a stream from CashFlowStream.amortizing has a schedule to prepay");
+  if (stream->defaulted)
+    rb_raise(rb_eRuntimeError, "prepay! must be run before default!");
+
+  VALUE smm_holder = Qnil;
+  double_buffer c_smm = DOUBLE_BUFFER_INIT;
+  const char *err;
+  if (kw_values[2] != Qundef) {
+    long t;
+    if ((err = _get_double_buffer(kw_values[2], &c_smm)) == NULL && c_smm.len != stream->num_cfs)
+      err = "smm must have one entry per period";
+    for (t = 0; err == NULL && t < c_smm.len; t++)
+      if (!(c_smm.ptr[t] >= 0.0 && c_smm.ptr[t] <= 1.0))
+        err = "smm must be between 0.0 and 1.0";
+    if (err != NULL) {
+      _release_double_buffer(&c_smm);
+      rb_raise(rb_eArgError, "%s", err);
+    }
+  } else {
+    c_smm.ptr = _alloc_doubles(stream->num_cfs, &smm_holder);
+    _smm_vector(kw_values[0] != Qundef ? CH_CPR : CH_PSA, NUM2DBL(kw_values[0] != Qundef ? kw_values[0] : kw_values[1]),
+      stream->frequency, kw_values[3] != Qundef ? NUM2LONG(kw_values[3]) : 0, stream->num_cfs, c_smm.ptr);
+  }
+
+  if (stream->solving > 0) {
+    _release_double_buffer(&c_smm);
+    _check_not_solving(stream);
+  }
+  _apply_prepayments(c_smm.ptr, stream->num_cfs, stream->balances, stream->interest, stream->principal, stream->cfs);
+
+  _release_double_buffer(&c_smm);
+  RB_GC_GUARD(smm_holder);
+  return self;
+}
+
+
+/* CashFlowStream#default!(cdr:, severity:, lag: 0)
+ * runs defaults through an amortizing stream's schedule in place (see _apply_defaults()): cdr: is the annual default
+ * rate, either a Float or an Array (or packed buffer) with one per period; severity: is the fraction of a defaulted
+ * balance that is lost, and lag: how many periods after the default the loss is taken and the rest recovered.
+ * Returns self
+ *
+ * afterwards the stream's cfs are the loss-adjusted ones, ready to solve or price; any prepay! has to come first
+ */
+static VALUE cash_flow_stream_default_bang(int argc, VALUE *argv, VALUE self) {
+  VALUE kwargs;
+  VALUE kw_values[3] = { Qundef, Qundef, Qundef };
+  ID kw_ids[3] = { rb_intern("cdr"), rb_intern("severity"), rb_intern("lag") };
+
+  rb_scan_args(argc, argv, ":", &kwargs);
+  rb_get_kwargs(NIL_P(kwargs) ? rb_hash_new() : kwargs, kw_ids, 2, 1, kw_values);
+  Check_Type(kw_values[1], T_FLOAT);
+  if (kw_values[2] != Qundef) Check_Type(kw_values[2], T_FIXNUM);
+
+  double severity = NUM2DBL(kw_values[1]);
+  long lag = kw_values[2] != Qundef ? NUM2LONG(kw_values[2]) : 0;
+  if (!(severity >= 0.0 && severity <= 1.0))  // written so that NaN fails too
+    rb_raise(rb_eArgError, "severity must be between 0.0 and 1.0");
+  if (lag < 0)
+    rb_raise(rb_eArgError, "lag must be >= 0");
+
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  if (stream->balances == NULL)
+    rb_raise(rb_eRuntimeError, "only a stream from CashFlowStream.amortizing has a schedule to default");
+
+  VALUE mdr_holder;
+  double *c_mdr = _alloc_doubles(stream->num_cfs, &mdr_holder);
+  long t;
+  if (RB_FLOAT_TYPE_P(kw_values[0])) {
+    for (t = 0; t < stream->num_cfs; t++)
+      c_mdr[t] = NUM2DBL(kw_values[0]);
+  } else {
+    double_buffer c_cdr = DOUBLE_BUFFER_INIT;
+    const char *err;
+    if ((err = _get_double_buffer(kw_values[0], &c_cdr)) == NULL && c_cdr.len != stream->num_cfs)
+      err = "cdr must be a Float or have one entry per period";
+    if (err != NULL) {
+      _release_double_buffer(&c_cdr);
+      rb_raise(rb_eArgError, "%s", err);
+    }
+    memcpy(c_mdr, c_cdr.ptr, stream->num_cfs * sizeof(double));
+    _release_double_buffer(&c_cdr);
+  }
+  for (t = 0; t < stream->num_cfs; t++)
+    if (!(c_mdr[t] >= 0.0 && c_mdr[t] <= 1.0))
+      rb_raise(rb_eArgError, "cdr must be between 0.0 and 1.0");
+  _periodic_rates(c_mdr, stream->frequency, stream->num_cfs, c_mdr);
+
+  _check_not_solving(stream);
+  _apply_defaults(c_mdr, stream->num_cfs, severity, lag, stream->balances, stream->interest, stream->principal,
+    stream->recoveries, stream->losses, stream->cfs);
+  stream->defaulted = 1;
+
+  RB_GC_GUARD(mdr_holder);
+  return self;
+}
+
+
+/* CashFlowStream#compute_pv(libor, spread, is_clean, accrued_interest, year_convention)
+ * the stream's PV at spread, as _compute_pv() computes it; libor is taken as in solve_spread
+ *
+ * assumes that is_clean is a boolean True or False
+ */
+static VALUE cash_flow_stream_compute_pv(VALUE self, VALUE libor, VALUE spread, VALUE is_clean, VALUE accrued_interest, VALUE year_convention) {
+  Check_Type(spread,            T_FLOAT);
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  if (!stream->strictly_increasing)
+    rb_raise(rb_eRuntimeError, "dates must contain a list of monotonically increasing values, starting at a value > 0");
+
+  double_buffer c_libor = DOUBLE_BUFFER_INIT;
+  const char *err = _get_libor_buffer(libor, stream->dates, stream->num_cfs, &c_libor);
+  if (err == NULL && c_libor.len != stream->num_cfs)
+    err = "libor must have one entry per cash flow";
+  if (err != NULL) {
+    _release_double_buffer(&c_libor);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  double pv = _compute_pv(stream->cfs, stream->dates, c_libor.ptr, stream->num_cfs, TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(accrued_interest), NUM2DBL(year_convention), NUM2DBL(spread));
+
+  _release_double_buffer(&c_libor);
+  return rb_float_new(pv);
+}
+
+
+/* _doubles_to_ary()
+ * internal function that copies len doubles into a new Array, or returns nil if there are none to copy
+ */
+static VALUE _doubles_to_ary(double *ptr, long len) {
+  VALUE ary;
+  long i;
+
+  if (ptr == NULL)
+    return Qnil;
+  ary = rb_ary_new_capa(len);
+  for (i = 0; i < len; i++)
+    rb_ary_push(ary, rb_float_new(ptr[i]));
+  return ary;
+}
+
+
+/* CashFlowStream#cfs, #dates, #balances, #interest, #principal, #recoveries and #losses
+ * the stream's buffers as Arrays, for inspection; balances (what each period's interest is paid on) and the rest of
+ * the schedule are nil unless the stream came from CashFlowStream.amortizing
+ */
+static VALUE cash_flow_stream_cfs(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->cfs, stream->num_cfs);
+}
+
+static VALUE cash_flow_stream_dates(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->dates, stream->num_cfs);
+}
+
+static VALUE cash_flow_stream_balances(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->balances, stream->num_cfs);
+}
+
+static VALUE cash_flow_stream_interest(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->interest, stream->num_cfs);
+}
+
+static VALUE cash_flow_stream_principal(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->principal, stream->num_cfs);
+}
+
+static VALUE cash_flow_stream_recoveries(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->recoveries, stream->num_cfs);
+}
+
+static VALUE cash_flow_stream_losses(VALUE self) {
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  return _doubles_to_ary(stream->losses, stream->num_cfs);
+}
+
+
+/* CashFlowStream#solve_spread(libor, target_px, res, max_tries, is_clean, accrued_interest, year_convention)
+ * backsolves the spread (or yield, with libor all 0's) the way backsolve_cf does, reusing the stream's buffers; libor
+ * can be an Array, a packed buffer of doubles or a CHelper::Curve, and is the only thing read from Ruby per solve
+ *
+ * the solve runs on those buffers without the GVL, so until it's done the stream is marked as solving and can't be
+ * changed (see _check_not_solving())
+ *
+ * takes the same keyword options as backsolve_cf
+ */
+static VALUE cash_flow_stream_solve_spread(int argc, VALUE *argv, VALUE self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 7);
+  VALUE libor = argv[0];
+  VALUE target_px = argv[1];
+  VALUE res = argv[2];
+  VALUE max_tries = argv[3];
+  VALUE is_clean = argv[4];
+  VALUE accrued_interest = argv[5];
+  VALUE year_convention = argv[6];
+  Check_Type(target_px,         T_FLOAT);
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, SPREAD_CACHE);
+
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+  if (!stream->strictly_increasing)
+    rb_raise(rb_eRuntimeError, "dates must contain a list of monotonically increasing values, starting at a value > 0");
+
+  double_buffer c_libor = DOUBLE_BUFFER_INIT;
+  const char *err = _get_libor_buffer(libor, stream->dates, stream->num_cfs, &c_libor);
+  if (err == NULL && c_libor.len != stream->num_cfs)
+    err = "libor must have one entry per cash flow";
+  if (err != NULL) {
+    _release_double_buffer(&c_libor);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  double c_target_px = NUM2DBL(target_px), c_accrued_interest = NUM2DBL(accrued_interest), c_result = 0.0, c_risk[3];
+  solve_job job = { stream->cfs, stream->dates, c_libor.ptr, &stream->num_cfs, &c_target_px, &c_accrued_interest, &c_result, 1,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(year_convention),
+    opts };
+  job.risk = _wants_risk(kwargs) ? c_risk : NULL;
+  stream->solving++;
+  int state = _solve_without_gvl(&job, started);
+  stream->solving--;
+
+  _release_double_buffer(&c_libor);
+  RB_GC_GUARD(self);  // keeps the stream's buffers alive until the solve is done
+
+  if (state)
+    rb_jump_tag(state);
+
+  _remember_solution(kwargs, SPREAD_CACHE, c_result);
+  return _solver_result(kwargs, c_result, &job.opts, job.risk);
+}
+
+
+/* CashFlowStream#solve_irr(res, max_tries, is_clean, accrued_interest)
+ * backsolves the IRR the way backsolve_irr does, reusing the stream's buffers (marked as solving, as for solve_spread)
+ */
+static VALUE cash_flow_stream_solve_irr(int argc, VALUE *argv, VALUE self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 4);
+  VALUE res = argv[0];
+  VALUE max_tries = argv[1];
+  VALUE is_clean = argv[2];
+  VALUE accrued_interest = argv[3];
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, IRR_CACHE);
+
+  cash_flow_stream *stream = _get_cash_flow_stream(self);
+
+  double c_accrued_interest = NUM2DBL(accrued_interest), c_result = 0.0, c_risk[3];
+  solve_job job = { stream->cfs, stream->dates, NULL, &stream->num_cfs, NULL, &c_accrued_interest, &c_result, 1,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    0.0,
+    opts };
+  job.risk = _wants_risk(kwargs) ? c_risk : NULL;
+  stream->solving++;
+  int state = _solve_without_gvl(&job, started);
+  stream->solving--;
+
+  RB_GC_GUARD(self);
+
+  if (state)
+    rb_jump_tag(state);
+
+  _remember_solution(kwargs, IRR_CACHE, c_result);
+  return _solver_result(kwargs, c_result, &job.opts, job.risk);
+}
+
+
+void Init_cash_flow_stream(VALUE mod) {
+  VALUE klass = rb_define_class_under(mod, "CashFlowStream", rb_cObject);
+  rb_define_alloc_func(klass, cash_flow_stream_alloc);
+  rb_define_singleton_method(klass, "amortizing", cash_flow_stream_s_amortizing, -1);
+  rb_define_method(klass, "initialize", cash_flow_stream_initialize, 2);
+  rb_define_method(klass, "initialize_copy", cash_flow_stream_initialize_copy, 1);
+  rb_define_method(klass, "size", cash_flow_stream_size, 0);
+  rb_define_method(klass, "cfs", cash_flow_stream_cfs, 0);
+  rb_define_method(klass, "dates", cash_flow_stream_dates, 0);
+  rb_define_method(klass, "balances", cash_flow_stream_balances, 0);
+  rb_define_method(klass, "interest", cash_flow_stream_interest, 0);
+  rb_define_method(klass, "principal", cash_flow_stream_principal, 0);
+  rb_define_method(klass, "recoveries", cash_flow_stream_recoveries, 0);
+  rb_define_method(klass, "losses", cash_flow_stream_losses, 0);
+  rb_define_method(klass, "solve_spread", cash_flow_stream_solve_spread, -1);
+  rb_define_method(klass, "solve_irr", cash_flow_stream_solve_irr, -1);
+  rb_define_method(klass, "compute_pv", cash_flow_stream_compute_pv, 5);
+  rb_define_method(klass, "prepay!", cash_flow_stream_prepay_bang, -1);
+  rb_define_method(klass, "default!", cash_flow_stream_default_bang, -1);
+}
\ No newline at end of file
@@ -0,0 +1,579 @@
+#include <ruby.h>
+#include <ruby/thread.h>  // for rb_thread_call_without_gvl()
+#include "c_helper.h"
+
+/* compute_pv.c
+ * exported functions for the forward problem, spread -> PV, built on the same kernels as the backsolves, and for
+ * pricing one loan under a whole set of libor scenarios at once
+ */
+
+
+
+#define GRID_CHUNK 256  // spreads per _compute_pv_multi() call, i.e. per pass over the cash flows, between interrupt polls
+
+typedef struct {
+  double *cfs, *dates, *libor;
+  long num_cfs;
+  char is_clean;
+  double accrued_interest, year_convention;
+  double *spreads;
+  long num_spreads;
+  double *pvs;
+  long next_spread;  // where to pick up after an interrupt
+  volatile int interrupted;
+} pv_grid_job;
+
+static void *_run_pv_grid_job(void *data) {
+  pv_grid_job *job = (pv_grid_job *)data;
+  long chunk;
+
+  for (; job->next_spread < job->num_spreads && !job->interrupted; job->next_spread += chunk) {
+    chunk = job->num_spreads - job->next_spread < GRID_CHUNK ? job->num_spreads - job->next_spread : GRID_CHUNK;
+    _compute_pv_multi(job->cfs, job->dates, job->libor, job->num_cfs, job->is_clean, job->accrued_interest, job->year_convention,
+      job->spreads + job->next_spread, chunk, job->pvs + job->next_spread);
+  }
+  return NULL;
+}
+
+static void _unblock_pv_grid_job(void *data) {
+  ((pv_grid_job *)data)->interrupted = 1;
+}
+
+static VALUE _call_pv_grid_job(VALUE data) {
+  pv_grid_job *job = (pv_grid_job *)data;
+
+  // if servicing an interrupt doesn't raise (e.g. a trap handler ran), carry on from the chunk we were on
+  while (job->next_spread < job->num_spreads) {
+    job->interrupted = 0;
+    rb_thread_call_without_gvl(_run_pv_grid_job, job, _unblock_pv_grid_job, job);
+  }
+  return Qnil;
+}
+
+
+typedef struct {
+  double *cfs, *dates, *libor;
+  long *num_cfs, num_loans;
+  double *spreads;           // every loan's spreads back to back
+  long *num_spreads;         // how many of them are loan i's
+  double *accrued_interest, year_convention;
+  double *statuses;          // 0.0, or the sentinel for a loan that can't be priced
+  double *dirty_pvs, *clean_pvs;  // laid out like spreads
+
+  long next_loan, next_offset, next_spread;  // where to pick up again after an interrupt
+  volatile int interrupted;
+} pv_batch_job;
+
+/* _run_pv_batch_job()
+ * internal function, called without the GVL, that prices the loans of a job from next_loan onwards, each at all its
+ * spreads in one sweep (see _compute_pv_multi()); the clean PV is the dirty one less the loan's accrued interest
+ */
+static void *_run_pv_batch_job(void *data) {
+  pv_batch_job *job = (pv_batch_job *)data;
+  double *dirty, *clean;
+  long i, j;
+
+  for (; job->next_loan < job->num_loans && !job->interrupted; job->next_loan++) {
+    i = job->next_loan;
+    dirty = job->dirty_pvs + job->next_spread;
+    clean = job->clean_pvs + job->next_spread;
+
+    if (job->statuses[i] == 0.0) {
+      _compute_pv_multi(job->cfs + job->next_offset, job->dates + job->next_offset, job->libor + job->next_offset, job->num_cfs[i],
+        0, 0.0, job->year_convention, job->spreads + job->next_spread, job->num_spreads[i], dirty);
+      for (j = 0; j < job->num_spreads[i]; j++)
+        clean[j] = dirty[j] - job->accrued_interest[i];
+    }
+
+    job->next_offset += job->num_cfs[i];
+    job->next_spread += job->num_spreads[i];
+  }
+
+  return NULL;
+}
+
+static void _unblock_pv_batch_job(void *data) {
+  ((pv_batch_job *)data)->interrupted = 1;
+}
+
+
+typedef struct {
+  double *cfs, *dates, *libor, *shifts;
+  long num_cfs, num_scenarios;
+  char is_clean;
+  double accrued_interest, year_convention, target_px;
+  double *spreads;  // compute_pv_scenarios: the spread for each scenario
+  double *results;  // the PV, or the spread or sentinel, for each scenario
+  solver_opts opts;
+  double status;    // backsolve_cf_scenarios: what _backsolve_cf_scenarios() returned
+  volatile int interrupted;
+} scenario_job;
+
+static void *_run_pv_scenarios_job(void *data) {
+  scenario_job *job = (scenario_job *)data;
+  _compute_pv_scenarios(job->cfs, job->dates, job->libor, job->shifts, job->num_cfs, job->num_scenarios, job->is_clean,
+    job->accrued_interest, job->year_convention, job->spreads, job->results);
+  return NULL;
+}
+
+static void *_run_solve_scenarios_job(void *data) {
+  scenario_job *job = (scenario_job *)data;
+  job->opts.interrupted = &job->interrupted;
+  job->status = _backsolve_cf_scenarios(job->cfs, job->dates, job->libor, job->shifts, job->num_cfs, job->num_scenarios,
+    job->target_px, job->is_clean, job->accrued_interest, job->year_convention, &job->opts, job->results);
+  return NULL;
+}
+
+static void _unblock_scenario_job(void *data) {
+  ((scenario_job *)data)->interrupted = 1;
+}
+
+
+typedef struct {
+  void *(*fn)(void *);
+  scenario_job *job;
+} scenario_call;
+
+static VALUE _call_scenario_job(VALUE data) {
+  scenario_call *call = (scenario_call *)data;
+
+  // an interrupted solve is simply rerun if servicing the interrupt didn't raise
+  do {
+    call->job->interrupted = 0;
+    call->job->status = 0.0;
+    rb_thread_call_without_gvl(call->fn, call->job, _unblock_scenario_job, call->job);
+  } while (call->job->status == CH_INTERRUPTED);
+
+  return Qnil;
+}
+
+
+/* _run_without_gvl()
+ * internal function that runs fn on a scenario job with the GVL released; as with _solve_without_gvl(), it returns
+ * the rb_protect() state, and the caller must release its buffers and then rb_jump_tag() if it is non-zero
+ */
+static int _run_without_gvl(void *(*fn)(void *), scenario_job *job) {
+  scenario_call call = { fn, job };
+  int state = 0;
+
+  rb_protect(_call_scenario_job, (VALUE)&call, &state);
+  return state;
+}
+
+
+/* compute_pv_grid
+ * exported function that prices one loan at a whole grid of spreads, e.g. for a price/spread table; returns an Array
+ * with the PV at each entry of spreads, each exactly what _compute_pv() gives for that spread, from a single pass over
+ * the cash flows (see _compute_pv_multi())
+ *
+ * cfs, dates and spreads can each be an Array or a packed buffer of doubles, and libor can also be a CHelper::Curve;
+ * dates are checked as in backsolve_cf, and the sweep runs without the GVL
+ *
+ * assumes that is_clean is a boolean True or False
+ */
+VALUE compute_pv_grid(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE spreads, VALUE is_clean, VALUE accrued_interest, VALUE year_convention) {
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT, c_libor = DOUBLE_BUFFER_INIT, c_spreads = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, &c_libor };
+  const char *err;
+
+  // spreads last: _get_packed_inputs() only releases its own buffers when it raises
+  _get_packed_inputs(cfs, dates, libor, bufs, 1);
+  if ((err = _get_double_buffer(spreads, &c_spreads)) != NULL) {
+    _release_double_buffer(&c_cfs);
+    _release_double_buffer(&c_dates);
+    _release_double_buffer(&c_libor);
+    _release_double_buffer(&c_spreads);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  VALUE pvs_holder;
+  pv_grid_job job = { c_cfs.ptr, c_dates.ptr, c_libor.ptr, c_cfs.len,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(accrued_interest),
+    NUM2DBL(year_convention),
+    c_spreads.ptr, c_spreads.len,
+    _alloc_doubles(c_spreads.len, &pvs_holder) };
+
+  // servicing an interrupt can raise, and the buffers have to be released first
+  int state = 0;
+  rb_protect(_call_pv_grid_job, (VALUE)&job, &state);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_libor);
+  _release_double_buffer(&c_spreads);
+
+  if (state)
+    rb_jump_tag(state);
+
+  VALUE result = rb_ary_new_capa(job.num_spreads);
+  long j;
+  for (j = 0; j < job.num_spreads; j++)
+    rb_ary_push(result, rb_float_new(job.pvs[j]));
+
+  RB_GC_GUARD(pvs_holder);
+  return result;
+}
+
+
+/* _get_shift_matrix()
+ * internal function that reads a scenario shift matrix, one row of num_cfs libor shifts per scenario, given either as
+ * an Array of rows (each an Array or a packed buffer) or as one packed buffer of the rows back to back, and lays it
+ * out transposed (scenario-fastest) in a new GC-owned buffer for _compute_pv_scenarios()
+ *
+ * raises if the rows aren't num_cfs long; call it before getting any double_buffers that would need releasing
+ */
+static double *_get_shift_matrix(VALUE shifts, long num_cfs, long *num_scenarios, VALUE *holder) {
+  double_buffer row = DOUBLE_BUFFER_INIT;
+  const char *err = NULL;
+  double *matrix;
+  long j, t, n;
+
+  if (RB_TYPE_P(shifts, T_ARRAY)) {
+    n = RARRAY_LEN(shifts);
+    matrix = _alloc_doubles(n * num_cfs, holder);
+    for (j = 0; j < n && err == NULL; j++) {
+      if ((err = _get_double_buffer(rb_ary_entry(shifts, j), &row)) == NULL && row.len != num_cfs)
+        err = "each scenario must have one shift per cash flow";
+      for (t = 0; err == NULL && t < num_cfs; t++)
+        matrix[t * n + j] = row.ptr[t];
+      _release_double_buffer(&row);
+    }
+  } else {
+    if ((err = _get_double_buffer(shifts, &row)) == NULL && (num_cfs < 1 || row.len % num_cfs != 0))
+      err = "each scenario must have one shift per cash flow";
+    n = err == NULL ? row.len / num_cfs : 0;
+    matrix = _alloc_doubles(n * num_cfs, holder);
+    for (j = 0; err == NULL && j < n; j++)
+      for (t = 0; t < num_cfs; t++)
+        matrix[t * n + j] = row.ptr[j * num_cfs + t];
+    _release_double_buffer(&row);
+  }
+
+  if (err != NULL)
+    rb_raise(rb_eArgError, "%s", err);
+
+  *num_scenarios = n;
+  return matrix;
+}
+
+
+/* _num_doubles_of()
+ * internal function that works out how many doubles obj (an Array or a packed buffer) holds, without keeping a buffer
+ * of it
+ */
+static long _num_doubles_of(VALUE obj) {
+  double_buffer buf = DOUBLE_BUFFER_INIT;
+  const char *err = _get_double_buffer(obj, &buf);
+  long len = buf.len;
+
+  _release_double_buffer(&buf);
+  if (err != NULL)
+    rb_raise(rb_eArgError, "%s", err);
+  return len;
+}
+
+
+/* compute_pv_scenarios
+ * exported function that prices one loan at a fixed spread under each of a set of libor scenarios: scenario j
+ * discounts at libor plus row j of shifts (see _get_shift_matrix()), so parallel shocks, twists or anything else are
+ * just different rows. Returns an Array with the PV under each scenario, exactly what _compute_pv() gives on libor
+ * shifted by hand, from one vectorized sweep over the cash flows (see _compute_pv_scenarios())
+ *
+ * cfs, dates and libor are taken as in compute_pv_grid; the sweep runs without the GVL
+ *
+ * assumes that is_clean is a boolean True or False
+ */
+VALUE compute_pv_scenarios(VALUE _self, VALUE cfs, VALUE dates, VALUE libor, VALUE shifts, VALUE spread, VALUE is_clean, VALUE accrued_interest, VALUE year_convention) {
+  Check_Type(spread,            T_FLOAT);
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+
+  VALUE shifts_holder, spreads_holder, pvs_holder;
+  long num_scenarios, j;
+  double *c_shifts = _get_shift_matrix(shifts, _num_doubles_of(cfs), &num_scenarios, &shifts_holder);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT, c_libor = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, &c_libor };
+  _get_packed_inputs(cfs, dates, libor, bufs, 1);
+
+  double *c_spreads = _alloc_doubles(num_scenarios, &spreads_holder);
+  double *c_pvs     = _alloc_doubles(num_scenarios, &pvs_holder);
+  for (j = 0; j < num_scenarios; j++)
+    c_spreads[j] = NUM2DBL(spread);
+
+  scenario_job job = { c_cfs.ptr, c_dates.ptr, c_libor.ptr, c_shifts, c_cfs.len, num_scenarios,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(accrued_interest),
+    NUM2DBL(year_convention),
+    0.0, c_spreads, c_pvs };
+  int state = _run_without_gvl(_run_pv_scenarios_job, &job);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_libor);
+
+  if (state)
+    rb_jump_tag(state);
+
+  VALUE result = rb_ary_new_capa(num_scenarios);
+  for (j = 0; j < num_scenarios; j++)
+    rb_ary_push(result, rb_float_new(c_pvs[j]));
+
+  RB_GC_GUARD(shifts_holder);
+  RB_GC_GUARD(spreads_holder);
+  RB_GC_GUARD(pvs_holder);
+  return result;
+}
+
+
+/* backsolve_cf_scenarios
+ * exported function that is to backsolve_cf what compute_pv_scenarios is to a single PV: the spread that gets the loan
+ * to target_px under each scenario, all solved together (see _backsolve_cf_scenarios()). Returns [spreads, statuses]
+ * as backsolve_cf_batch does, with one entry per scenario
+ *
+ * the scenarios are solved in lockstep by the secant method, so the only keyword option is guess:
+ *
+ * assumes that is_clean is a boolean True or False
+ */
+VALUE backsolve_cf_scenarios(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 10);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE libor = argv[2];
+  VALUE shifts = argv[3];
+  VALUE target_px = argv[4];
+  VALUE res = argv[5];
+  VALUE max_tries = argv[6];
+  VALUE is_clean = argv[7];
+  VALUE accrued_interest = argv[8];
+  VALUE year_convention = argv[9];
+  Check_Type(target_px,         T_FLOAT);
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+  solver_opts opts = _get_solver_opts(res, max_tries, kwargs, NO_CACHE);
+  if (opts.method != CH_SECANT)
+    rb_raise(rb_eArgError, "scenarios are solved by the secant method only");
+
+  VALUE shifts_holder, results_holder;
+  long num_scenarios, j;
+  double *c_shifts = _get_shift_matrix(shifts, _num_doubles_of(cfs), &num_scenarios, &shifts_holder);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT, c_libor = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, &c_libor };
+  _get_packed_inputs(cfs, dates, libor, bufs, 1);
+
+  double *c_results = _alloc_doubles(num_scenarios, &results_holder);
+  scenario_job job = { c_cfs.ptr, c_dates.ptr, c_libor.ptr, c_shifts, c_cfs.len, num_scenarios,
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(accrued_interest),
+    NUM2DBL(year_convention),
+    NUM2DBL(target_px), NULL, c_results, opts };
+  long solve_started = _clock_ns();
+  int state = _run_without_gvl(_run_solve_scenarios_job, &job);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_libor);
+
+  if (state)
+    rb_jump_tag(state);
+  if (job.status == CH_NO_MEMORY)
+    rb_raise(rb_eNoMemError, "failed to allocate memory for solver");
+
+  // every scenario counts as a solve taking as many iterations as the lockstep did, with an evaluation per sweep
+  solver_stats stats = { 0 };
+  for (j = 0; j < num_scenarios; j++)
+    _count_solve(&stats, c_results[j], &job.opts);
+  stats.pv_evaluations = num_scenarios * (job.opts.iterations + 2);
+  _record_stats(&stats, started, solve_started, _clock_ns());
+
+  VALUE spreads  = rb_ary_new_capa(num_scenarios);
+  VALUE statuses = rb_ary_new_capa(num_scenarios);
+  for (j = 0; j < num_scenarios; j++) {
+    int status = _status_of(c_results[j]);
+    rb_ary_push(spreads,  status == 0 ? rb_float_new(c_results[j]) : Qnil);
+    rb_ary_push(statuses, INT2FIX(status));
+  }
+
+  RB_GC_GUARD(shifts_holder);
+  RB_GC_GUARD(results_holder);
+  return rb_assoc_new(spreads, statuses);
+}
+
+
+/* compute_pv_batch
+ * exported function that prices a whole portfolio from spread in one call, the forward counterpart of
+ * backsolve_cf_batch: loan i is cfs_list[i], dates_list[i], libor_list[i] and accrued_interests[i], priced at
+ * spreads[i], which is either a Float or an Array (or packed buffer) of spreads to price that loan at
+ *
+ * returns [dirty_pvs, clean_pvs, statuses]; dirty_pvs[i] and clean_pvs[i] are Floats if spreads[i] was, Arrays of one
+ * PV per spread otherwise, and nil if loan i couldn't be priced, in which case statuses[i] says why (as in
+ * backsolve_cf_batch, a bad loan doesn't fail the batch)
+ *
+ * libor_list can be a single CHelper::Curve for every loan, and any loan's libor can be a Curve. The inputs are packed
+ * the same way as for backsolve_cf_batch, into GC-owned buffers, so nothing needs freeing if we raise or get
+ * interrupted, and the whole batch is priced without the GVL
+ *
+ * assumes that the numeric classes are as per below, and Ruby won't, e.g., throw in a BigNum or some other class
+ */
+VALUE compute_pv_batch(VALUE _self, VALUE cfs_list, VALUE dates_list, VALUE libor_list, VALUE spreads, VALUE accrued_interests, VALUE year_convention) {
+  Check_Type(cfs_list,          T_ARRAY);
+  Check_Type(dates_list,        T_ARRAY);
+  ch_curve *shared_curve = _get_curve(libor_list);
+  if (shared_curve == NULL)
+    Check_Type(libor_list,      T_ARRAY);
+  Check_Type(spreads,           T_ARRAY);
+  Check_Type(accrued_interests, T_ARRAY);
+  Check_Type(year_convention,   T_FLOAT);
+
+  long num_loans = RARRAY_LEN(cfs_list);
+  long i, offset, total_spreads = 0;
+
+  if (RARRAY_LEN(dates_list) != num_loans || (shared_curve == NULL && RARRAY_LEN(libor_list) != num_loans) ||
+      RARRAY_LEN(spreads) != num_loans || RARRAY_LEN(accrued_interests) != num_loans)
+    rb_raise(rb_eArgError, "cfs, dates, libor, spread and accrued_interest lists must all have one entry per loan");
+
+  // check types and size the shared buffers before allocating anything
+  long total_cfs = _batch_total_cfs(cfs_list, dates_list, libor_list, shared_curve);
+  for (i = 0; i < num_loans; i++) {
+    VALUE loan_spreads = rb_ary_entry(spreads, i);
+    total_spreads += RB_FLOAT_TYPE_P(loan_spreads) ? 1 : _num_doubles_of(loan_spreads);
+  }
+
+  VALUE cfs_holder, dates_holder, libor_holder, num_cfs_holder, num_spreads_holder, spreads_holder, accrued_holder,
+    statuses_holder, dirty_holder, clean_holder;
+  pv_batch_job job = {
+    _alloc_doubles(total_cfs, &cfs_holder),
+    _alloc_doubles(total_cfs, &dates_holder),
+    _alloc_doubles(total_cfs, &libor_holder),
+    ALLOCV_N(long, num_cfs_holder, num_loans + 1), num_loans,
+    _alloc_doubles(total_spreads, &spreads_holder),
+    ALLOCV_N(long, num_spreads_holder, num_loans + 1),
+    _alloc_doubles(num_loans, &accrued_holder),
+    NUM2DBL(year_convention),
+    _alloc_doubles(num_loans, &statuses_holder),
+    _alloc_doubles(total_spreads, &dirty_holder),
+    _alloc_doubles(total_spreads, &clean_holder) };
+
+  double_buffer loan_spreads = DOUBLE_BUFFER_INIT;
+  const char *err;
+  long spread_offset = 0;
+  for (i = 0, offset = 0; i < num_loans; i++) {
+    VALUE loan_spread = rb_ary_entry(spreads, i);
+    if (RB_FLOAT_TYPE_P(loan_spread)) {
+      job.spreads[spread_offset] = NUM2DBL(loan_spread);
+      job.num_spreads[i] = 1;
+    } else {
+      if ((err = _get_double_buffer(loan_spread, &loan_spreads)) != NULL) {
+        _release_double_buffer(&loan_spreads);
+        rb_raise(rb_eArgError, "%s", err);
+      }
+      MEMCPY(job.spreads + spread_offset, loan_spreads.ptr, double, loan_spreads.len);
+      job.num_spreads[i] = loan_spreads.len;
+      _release_double_buffer(&loan_spreads);
+    }
+
+    job.num_cfs[i]          = RARRAY_LEN(rb_ary_entry(cfs_list, i));
+    job.accrued_interest[i] = NUM2DBL(rb_ary_entry(accrued_interests, i));
+    job.statuses[i]         = _pack_loan(cfs_list, dates_list, libor_list, shared_curve, i, job.cfs + offset, job.dates + offset, job.libor + offset);
+    offset += job.num_cfs[i];
+    spread_offset += job.num_spreads[i];
+  }
+
+  // every buffer is GC-owned, so if servicing an interrupt raises there's nothing to clean up; if it doesn't (e.g. a
+  // trap handler ran), carry on from the loan we were on
+  while (job.next_loan < num_loans) {
+    job.interrupted = 0;
+    rb_thread_call_without_gvl(_run_pv_batch_job, &job, _unblock_pv_batch_job, &job);
+  }
+
+  VALUE dirty_pvs = rb_ary_new_capa(num_loans);
+  VALUE clean_pvs = rb_ary_new_capa(num_loans);
+  VALUE statuses  = rb_ary_new_capa(num_loans);
+  long j;
+  for (i = 0, spread_offset = 0; i < num_loans; spread_offset += job.num_spreads[i], i++) {
+    int status = _status_of(job.statuses[i]);
+    rb_ary_push(statuses, INT2FIX(status));
+    if (status != 0) {
+      rb_ary_push(dirty_pvs, Qnil);
+      rb_ary_push(clean_pvs, Qnil);
+    } else if (RB_FLOAT_TYPE_P(rb_ary_entry(spreads, i))) {
+      rb_ary_push(dirty_pvs, rb_float_new(job.dirty_pvs[spread_offset]));
+      rb_ary_push(clean_pvs, rb_float_new(job.clean_pvs[spread_offset]));
+    } else {
+      VALUE loan_dirty = rb_ary_new_capa(job.num_spreads[i]), loan_clean = rb_ary_new_capa(job.num_spreads[i]);
+      for (j = 0; j < job.num_spreads[i]; j++) {
+        rb_ary_push(loan_dirty, rb_float_new(job.dirty_pvs[spread_offset + j]));
+        rb_ary_push(loan_clean, rb_float_new(job.clean_pvs[spread_offset + j]));
+      }
+      rb_ary_push(dirty_pvs, loan_dirty);
+      rb_ary_push(clean_pvs, loan_clean);
+    }
+  }
+
+  RB_GC_GUARD(cfs_holder);
+  RB_GC_GUARD(dates_holder);
+  RB_GC_GUARD(libor_holder);
+  RB_GC_GUARD(spreads_holder);
+  RB_GC_GUARD(accrued_holder);
+  RB_GC_GUARD(statuses_holder);
+  RB_GC_GUARD(dirty_holder);
+  RB_GC_GUARD(clean_holder);
+  ALLOCV_END(num_cfs_holder);
+  ALLOCV_END(num_spreads_holder);
+  return rb_ary_new_from_args(3, dirty_pvs, clean_pvs, statuses);
+}
+
+
+/* year_fraction
+ * exported function that gives the fraction of a year from one serial date (a Julian Day Number, Date#jd) to another
+ * under day_count, one of :act_365f, :act_360, :thirty_360 or :act_act_isda
+ */
+VALUE year_fraction(VALUE _self, VALUE from, VALUE to, VALUE day_count) {
+  return rb_float_new(_year_fraction(NUM2DBL(from), NUM2DBL(to), _get_day_count(day_count)));
+}
+
+
+/* accrual_dates
+ * exported function that does the day counting for a loan's cash flows natively, rather than in Ruby with a Date per
+ * cash flow: takes serial dates (Julian Day Numbers, as an Array or a packed buffer of doubles), the settlement date
+ * and a day_count as for year_fraction, and returns [dates, year_convention], the dates as a packed String, ready to
+ * pass as they are to backsolve_cf_packed, compute_pv_grid and the rest (see _accrual_dates())
+ */
+VALUE accrual_dates(VALUE _self, VALUE dates, VALUE settle, VALUE day_count) {
+  int c_day_count = _get_day_count(day_count);
+  double c_settle = NUM2DBL(settle);
+  double_buffer c_dates = DOUBLE_BUFFER_INIT;
+  const char *err;
+  VALUE accrual_holder;
+
+  if ((err = _get_double_buffer(dates, &c_dates)) != NULL) {
+    _release_double_buffer(&c_dates);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  double *c_accrual_dates = _alloc_doubles(c_dates.len, &accrual_holder);
+  double year_convention = _accrual_dates(c_dates.ptr, c_dates.len, c_settle, c_day_count, c_accrual_dates);
+  VALUE result = rb_str_new((const char *)c_accrual_dates, c_dates.len * sizeof(double));
+
+  _release_double_buffer(&c_dates);
+  RB_GC_GUARD(accrual_holder);
+  return rb_assoc_new(result, rb_float_new(year_convention));
+}
+
+
+void Init_compute_pv(VALUE mod) {
+  rb_define_module_function(mod, "compute_pv_batch", compute_pv_batch, 6);
+  rb_define_module_function(mod, "compute_pv_grid", compute_pv_grid, 7);
+  rb_define_module_function(mod, "compute_pv_scenarios", compute_pv_scenarios, 8);
+  rb_define_module_function(mod, "backsolve_cf_scenarios", backsolve_cf_scenarios, -1);
+  rb_define_module_function(mod, "year_fraction", year_fraction, 3);
+  rb_define_module_function(mod, "accrual_dates", accrual_dates, 3);
+}
\ No newline at end of file
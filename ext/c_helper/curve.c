@@ -0,0 +1,286 @@
+#include <string.h>
+#include <ruby.h>
+#include "c_helper.h"
+
+/* curve.c
+ * CHelper::Curve, a libor curve held in native memory: pillar dates (in the same days as the cash-flow dates) and the
+ * rates at them, interpolated linearly, log-linearly in discount factor or by a monotone cubic. Anywhere a libor
+ * Array is taken, a Curve can be passed instead, and the libor for each cash flow is read off the curve at its date
+ */
+
+
+
+/* _pillar_index()
+ * internal function that finds the pillar interval holding date: the i in [0, num_pillars - 2] with
+ * dates[i] <= date < dates[i + 1], clamped at either end
+ *
+ * the search is branchless (the comparison only picks how far to move, which compiles to a conditional move), so it
+ * costs the same log2(num_pillars) steps wherever date lands, with nothing for the branch predictor to get wrong
+ *
+ * assumes that num_pillars >= 2
+ */
+static long _pillar_index(const double *dates, long num_pillars, double date) {
+  const double *base = dates;
+  long len = num_pillars - 1, half;
+
+  while (len > 1) {
+    half = len / 2;
+    base += (base[half] <= date) ? half : 0;
+    len -= half;
+  }
+
+  return base - dates;
+}
+
+
+/* _curve_rates()
+ * internal function that reads the curve at each of num_dates dates into rates; rates are held flat outside the
+ * pillars
+ *
+ * CH_LOG_LINEAR_DF treats the pillar rates as continuously compounded zero rates, so that log DF(t) is -r(t) * t up to
+ * the day count; interpolating that linearly and converting back gives r(t) * t linear in t, whatever the day count
+ */
+void _curve_rates(ch_curve *curve, double *dates, long num_dates, double *rates) {
+  double *x = curve->dates, *y = curve->rates, *m = curve->slopes;
+  double t, h, s, s2, s3;
+  long i, k, n = curve->num_pillars;
+
+  for (k = 0; k < num_dates; k++) {
+    t = dates[k];
+    if (n == 1 || t <= x[0]) {
+      rates[k] = y[0];
+      continue;
+    } else if (t >= x[n - 1]) {
+      rates[k] = y[n - 1];
+      continue;
+    }
+
+    i = _pillar_index(x, n, t);
+    h = x[i + 1] - x[i];
+    s = (t - x[i]) / h;
+
+    switch (curve->interpolation) {
+      case CH_LOG_LINEAR_DF:
+        rates[k] = ((1.0 - s) * y[i] * x[i] + s * y[i + 1] * x[i + 1]) / t;
+        break;
+      case CH_MONOTONE_CUBIC:  // cubic Hermite on the slopes from _monotone_slopes()
+        s2 = s * s;
+        s3 = s2 * s;
+        rates[k] = (2.0 * s3 - 3.0 * s2 + 1.0) * y[i] + (s3 - 2.0 * s2 + s) * h * m[i] +
+                   (-2.0 * s3 + 3.0 * s2) * y[i + 1] + (s3 - s2) * h * m[i + 1];
+        break;
+      default:
+        rates[k] = y[i] + s * (y[i + 1] - y[i]);
+    }
+  }
+}
+
+
+/* _monotone_slopes()
+ * internal function that works out the slope at each pillar for CH_MONOTONE_CUBIC, by Fritsch-Butland: the slope is a
+ * weighted harmonic mean of the secants either side, or 0 at a local extremum, which keeps the cubic monotone wherever
+ * the pillars are, so it never overshoots the way a natural spline can
+ */
+static void _monotone_slopes(double *x, double *y, long n, double *m) {
+  double h0, h1, d0, d1;
+  long i;
+
+  if (n < 2) {
+    if (n == 1) m[0] = 0.0;
+    return;
+  }
+
+  m[0]     = (y[1] - y[0]) / (x[1] - x[0]);
+  m[n - 1] = (y[n - 1] - y[n - 2]) / (x[n - 1] - x[n - 2]);
+  for (i = 1; i < n - 1; i++) {
+    h0 = x[i] - x[i - 1];
+    h1 = x[i + 1] - x[i];
+    d0 = (y[i] - y[i - 1]) / h0;
+    d1 = (y[i + 1] - y[i]) / h1;
+    m[i] = d0 * d1 <= 0.0 ? 0.0 : 3.0 * (h0 + h1) / ((2.0 * h1 + h0) / d0 + (h1 + 2.0 * h0) / d1);
+  }
+}
+
+
+static void _curve_free(void *ptr) {
+  ch_curve *curve = (ch_curve *)ptr;
+  free(curve->dates);  // rates and slopes share the allocation
+  free(curve);
+}
+
+static size_t _curve_memsize(const void *ptr) {
+  const ch_curve *curve = (const ch_curve *)ptr;
+  return sizeof(*curve) + 3 * curve->num_pillars * sizeof(double);
+}
+
+static const rb_data_type_t curve_type = {
+  "CHelper::Curve",
+  { NULL, _curve_free, _curve_memsize, },
+  NULL, NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+
+static VALUE curve_alloc(VALUE klass) {
+  ch_curve *curve;
+  return TypedData_Make_Struct(klass, ch_curve, &curve_type, curve);
+}
+
+
+/* _get_curve()
+ * internal function that unwraps a Curve, or returns NULL if obj isn't one; raises if it was never initialized
+ */
+ch_curve *_get_curve(VALUE obj) {
+  ch_curve *curve;
+
+  if (!rb_typeddata_is_kind_of(obj, &curve_type))
+    return NULL;
+  curve = RTYPEDDATA_DATA(obj);
+  if (curve->dates == NULL)
+    rb_raise(rb_eRuntimeError, "uninitialized Curve");
+  return curve;
+}
+
+
+/* _get_libor_buffer()
+ * internal function for the exported functions that take libor: if libor is a Curve, reads it at each of the num_cfs
+ * dates into a new buffer, otherwise gets libor's doubles with _get_double_buffer(); returns an error message or NULL,
+ * as _get_double_buffer() does
+ */
+const char *_get_libor_buffer(VALUE libor, double *dates, long num_cfs, double_buffer *buf) {
+  ch_curve *curve = _get_curve(libor);
+
+  if (curve == NULL)
+    return _get_double_buffer(libor, buf);
+
+  buf->ptr = _alloc_doubles(num_cfs, &buf->holder);
+  buf->len = num_cfs;
+  _curve_rates(curve, dates, num_cfs, buf->ptr);
+  return NULL;
+}
+
+
+/* Curve#initialize(dates, rates, interpolation = :linear)
+ * copies the pillars (Arrays, or packed buffers of doubles) into native memory; dates must be strictly increasing, and
+ * > 0 for :log_linear_df. interpolation is :linear, :log_linear_df or :monotone_cubic
+ */
+static VALUE curve_initialize(int argc, VALUE *argv, VALUE self) {
+  VALUE dates, rates, interpolation;
+  ch_curve *curve;
+  TypedData_Get_Struct(self, ch_curve, &curve_type, curve);
+
+  rb_scan_args(argc, argv, "21", &dates, &rates, &interpolation);
+
+  int c_interpolation = CH_LINEAR;
+  if (NIL_P(interpolation) || interpolation == ID2SYM(rb_intern("linear")))
+    c_interpolation = CH_LINEAR;
+  else if (interpolation == ID2SYM(rb_intern("log_linear_df")))
+    c_interpolation = CH_LOG_LINEAR_DF;
+  else if (interpolation == ID2SYM(rb_intern("monotone_cubic")))
+    c_interpolation = CH_MONOTONE_CUBIC;
+  else
+    rb_raise(rb_eArgError, "unknown interpolation %"PRIsVALUE" (expected :linear, :log_linear_df or :monotone_cubic)", interpolation);
+
+  double_buffer c_dates = DOUBLE_BUFFER_INIT, c_rates = DOUBLE_BUFFER_INIT;
+  const char *err;
+  long i, n;
+
+  if ((err = _get_double_buffer(dates, &c_dates)) != NULL || (err = _get_double_buffer(rates, &c_rates)) != NULL) {
+    _release_double_buffer(&c_dates);
+    _release_double_buffer(&c_rates);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  n = c_dates.len;
+  if (n < 1)
+    err = "a curve must have at least one pillar";
+  else if (c_rates.len != n)
+    err = "dates and rates must have the same number of entries";
+  else if (c_interpolation == CH_LOG_LINEAR_DF && c_dates.ptr[0] <= 0.0)
+    err = "pillar dates must be > 0 to interpolate log-linearly in discount factor";
+  for (i = 1; err == NULL && i < n; i++)
+    if (c_dates.ptr[i] <= c_dates.ptr[i - 1])
+      err = "pillar dates must be strictly increasing";
+
+  if (err == NULL) {
+    // re-initializing replaces the old pillars
+    free(curve->dates);
+    curve->num_pillars = 0;
+    curve->dates = malloc(3 * n * sizeof(double));
+    if (curve->dates == NULL) {
+      _release_double_buffer(&c_dates);
+      _release_double_buffer(&c_rates);
+      rb_raise(rb_eNoMemError, "failed to allocate memory for Curve");
+    }
+
+    curve->rates  = curve->dates + n;
+    curve->slopes = curve->dates + 2 * n;
+    memcpy(curve->dates, c_dates.ptr, n * sizeof(double));
+    memcpy(curve->rates, c_rates.ptr, n * sizeof(double));
+    _monotone_slopes(curve->dates, curve->rates, n, curve->slopes);
+    curve->num_pillars = n;
+    curve->interpolation = c_interpolation;
+  }
+
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_rates);
+
+  if (err != NULL)
+    rb_raise(rb_eRuntimeError, "%s", err);
+
+  return self;
+}
+
+
+/* Curve#rate(date)
+ * the curve read at one date
+ */
+static VALUE curve_rate(VALUE self, VALUE date) {
+  double c_date = NUM2DBL(date), c_rate;
+  _curve_rates(_get_curve(self), &c_date, 1, &c_rate);
+  return rb_float_new(c_rate);
+}
+
+
+/* Curve#rates(dates)
+ * the curve read at each of dates (an Array, or a packed buffer of doubles), as an Array; this is the libor a solve
+ * would use for cash flows on those dates
+ */
+static VALUE curve_rates(VALUE self, VALUE dates) {
+  ch_curve *curve = _get_curve(self);
+  double_buffer c_dates = DOUBLE_BUFFER_INIT;
+  const char *err;
+  VALUE rates_holder, result;
+  long i;
+
+  if ((err = _get_double_buffer(dates, &c_dates)) != NULL) {
+    _release_double_buffer(&c_dates);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  double *c_rates = _alloc_doubles(c_dates.len, &rates_holder);
+  _curve_rates(curve, c_dates.ptr, c_dates.len, c_rates);
+
+  result = rb_ary_new_capa(c_dates.len);
+  for (i = 0; i < c_dates.len; i++)
+    rb_ary_push(result, rb_float_new(c_rates[i]));
+
+  _release_double_buffer(&c_dates);
+  RB_GC_GUARD(rates_holder);
+  return result;
+}
+
+
+static VALUE curve_size(VALUE self) {
+  return LONG2NUM(_get_curve(self)->num_pillars);
+}
+
+
+void Init_curve(VALUE mod) {
+  VALUE klass = rb_define_class_under(mod, "Curve", rb_cObject);
+  rb_define_alloc_func(klass, curve_alloc);
+  rb_define_method(klass, "initialize", curve_initialize, -1);
+  rb_define_method(klass, "rate", curve_rate, 1);
+  rb_define_method(klass, "rates", curve_rates, 1);
+  rb_define_method(klass, "size", curve_size, 0);
+}
\ No newline at end of file
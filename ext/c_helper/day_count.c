@@ -0,0 +1,150 @@
+#include <math.h>
+#include "c_helper.h"
+
+/* day_count.c
+ * the day-count conventions, worked on serial dates: Julian Day Numbers, as Ruby's Date#jd gives them, held in
+ * doubles like every other date the solvers take. Only the whole-day part of a date is looked at for the calendar
+ * conventions; the Actual ones are plain differences, so they work on any day numbering. Like solver.c, nothing in here
+ * touches the Ruby API
+ */
+
+
+
+/* _civil_from_serial()
+ * internal function that splits a Julian Day Number into its Gregorian year, month and day (Fliegel and Van Flandern)
+ */
+void _civil_from_serial(long serial, long *year, long *month, long *day) {
+  long l = serial + 68569, n, i, j;
+
+  n = 4 * l / 146097;
+  l -= (146097 * n + 3) / 4;
+  i = 4000 * (l + 1) / 1461001;
+  l -= 1461 * i / 4 - 31;
+  j = 80 * l / 2447;
+  *day = l - 2447 * j / 80;
+  l = j / 11;
+  *month = j + 2 - 12 * l;
+  *year = 100 * (n - 49) + i + l;
+}
+
+
+/* _serial_from_civil()
+ * internal function that is the inverse of _civil_from_serial()
+ */
+long _serial_from_civil(long year, long month, long day) {
+  long a = (14 - month) / 12, y = year + 4800 - a, m = month + 12 * a - 3;
+  return day + (153 * m + 2) / 5 + 365 * y + y / 4 - y / 100 + y / 400 - 32045;
+}
+
+
+static int _is_leap_year(long year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+
+long _days_in_month(long year, long month) {
+  static const long days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  return month == 2 && _is_leap_year(year) ? 29 : days[month - 1];
+}
+
+
+/* _days_30_360()
+ * internal function that counts the days from one date to another on the 30/360 bond basis (ISDA 2006 4.16(f)): a
+ * 31st is treated as the 30th, except that the end date only is when the start date is the 30th or 31st
+ */
+static double _days_30_360(double from, double to) {
+  long y1, m1, d1, y2, m2, d2;
+
+  _civil_from_serial((long)floor(from), &y1, &m1, &d1);
+  _civil_from_serial((long)floor(to), &y2, &m2, &d2);
+  if (d1 == 31)
+    d1 = 30;
+  if (d2 == 31 && d1 == 30)
+    d2 = 30;
+  return 360.0 * (y2 - y1) + 30.0 * (m2 - m1) + (d2 - d1);
+}
+
+
+/* _year_fraction()
+ * internal function that gives the fraction of a year from one date to another under day_count; negative if to is
+ * before from
+ *
+ * CH_ACT_ACT_ISDA splits the span at each January 1st, and counts the days that fall in a leap year over 366 and the
+ * rest over 365
+ */
+double _year_fraction(double from, double to, int day_count) {
+  long y1, y2, m, d, jan1_after, jan1_to;
+
+  switch (day_count) {
+    case CH_ACT_360:
+      return (to - from) / 360.0;
+    case CH_30_360:
+      return _days_30_360(from, to) / 360.0;
+    case CH_ACT_ACT_ISDA:
+      if (to < from)
+        return -_year_fraction(to, from, day_count);
+      _civil_from_serial((long)floor(from), &y1, &m, &d);
+      _civil_from_serial((long)floor(to), &y2, &m, &d);
+      if (y1 == y2)
+        return (floor(to) - floor(from)) / (_is_leap_year(y1) ? 366.0 : 365.0);
+      jan1_after = _serial_from_civil(y1 + 1, 1, 1);
+      jan1_to    = _serial_from_civil(y2, 1, 1);
+      return (jan1_after - floor(from)) / (_is_leap_year(y1) ? 366.0 : 365.0) + (y2 - y1 - 1) +
+             (floor(to) - jan1_to) / (_is_leap_year(y2) ? 366.0 : 365.0);
+    default:
+      return (to - from) / 365.0;
+  }
+}
+
+
+/* _year_fractions()
+ * internal function that gives the fraction of a year from origin to each of num_dates dates under day_count, which is
+ * what an IRR discounts each cash flow over
+ */
+void _year_fractions(double *dates, long num_dates, double origin, int day_count, double *year_fractions) {
+  long t;
+
+  switch (day_count) {
+    case CH_ACT_365F:  // the same arithmetic _irr_year_fractions() has always done, so existing IRRs don't move
+      for (t = 0; t < num_dates; t++)
+        year_fractions[t] = (dates[t] - origin) / 365.0;
+      break;
+    case CH_ACT_360:
+      for (t = 0; t < num_dates; t++)
+        year_fractions[t] = (dates[t] - origin) / 360.0;
+      break;
+    default:
+      for (t = 0; t < num_dates; t++)
+        year_fractions[t] = _year_fraction(origin, dates[t], day_count);
+  }
+}
+
+
+/* _accrual_dates()
+ * internal function that turns num_dates serial dates into the dates the _compute_pv() family takes, counted from
+ * settle, and returns the year_convention to pass along with them; each period's (dates[t] - dates[t - 1]) /
+ * year_convention then comes out as its year fraction under day_count
+ *
+ * the Actual conventions are plain day counts over 360 or 365. CH_30_360 sums each period's 30/360 days, which are
+ * whole numbers, so the sum is exact. CH_ACT_ACT_ISDA has no fixed denominator, so its dates are the running sum of
+ * the periods' year fractions, over a year_convention of 1.0
+ */
+double _accrual_dates(double *dates, long num_dates, double settle, int day_count, double *accrual_dates) {
+  double prev_date = settle, cumul = 0.0;
+  long t;
+
+  switch (day_count) {
+    case CH_30_360:
+    case CH_ACT_ACT_ISDA:
+      for (t = 0; t < num_dates; t++) {
+        cumul += day_count == CH_30_360 ? _days_30_360(prev_date, dates[t]) : _year_fraction(prev_date, dates[t], day_count);
+        accrual_dates[t] = cumul;
+        prev_date = dates[t];
+      }
+      return day_count == CH_30_360 ? 360.0 : 1.0;
+    default:
+      for (t = 0; t < num_dates; t++)
+        accrual_dates[t] = dates[t] - settle;
+      return day_count == CH_ACT_360 ? 360.0 : 365.0;
+  }
+}
\ No newline at end of file
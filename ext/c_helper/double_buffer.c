@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <string.h>
+#include <ruby.h>
+#include "c_helper.h"
+
+/* double_buffer.c
+ * zero-copy access to contiguous buffers of doubles held by Ruby objects, so that callers who already keep their cash
+ * flows packed (e.g. Array#pack('d*')) can hand them to the solvers without us walking an Array element by element
+ */
+
+
+
+/* _alloc_doubles()
+ * internal function that allocates scratch space for len doubles inside a hidden Ruby String, returned in *holder;
+ * the memory belongs to the GC, so nothing leaks if we raise (or are interrupted) while using it, as long as *holder
+ * stays on the stack
+ */
+double *_alloc_doubles(long len, VALUE *holder) {
+  // one spare double so the start can always be rounded up to an 8-byte boundary
+  *holder = rb_str_new(NULL, (len + 1) * sizeof(double));
+  return (double *)(((uintptr_t)RSTRING_PTR(*holder) + sizeof(double) - 1) & ~(uintptr_t)(sizeof(double) - 1));
+}
+
+
+/* _get_double_buffer()
+ * internal function that points buf at the doubles held by obj, which can be
+ *  - a String whose bytesize is a multiple of 8, read as native-endian doubles (i.e. what Array#pack('d*') produces)
+ *  - on Ruby 3.0+, any object that exports a contiguous one-dimensional MemoryView with format "d" (copied if it
+ *    isn't 8-byte aligned)
+ *  - an Array of numerics, for convenience; this is the one case that converts, into a String that buf->holder keeps
+ *    alive, so nothing leaks if an entry isn't numeric and NUM2DBL raises (the only way this function can raise)
+ *
+ * for a String we keep a frozen copy-on-write twin of it in buf->holder: the bytes are shared rather than copied, and
+ *  if the caller's String is modified while we're solving without the GVL, it's the caller's String that gets a fresh
+ *  buffer, not ours. The only copy made is when the bytes aren't 8-byte aligned (e.g. a String sliced at an odd
+ *  offset)
+ *
+ * returns NULL on success or an error message, in which case the caller should release whatever buffers it already
+ *  got and raise with the message. buf must be zeroed (DOUBLE_BUFFER_INIT) before the call
+ */
+const char *_get_double_buffer(VALUE obj, double_buffer *buf) {
+  if (RB_TYPE_P(obj, T_ARRAY)) {
+    long i;
+
+    buf->len = RARRAY_LEN(obj);
+    buf->ptr = _alloc_doubles(buf->len, &buf->holder);
+    for (i = 0; i < buf->len; i++)
+      buf->ptr[i] = NUM2DBL(rb_ary_entry(obj, i));
+
+    return NULL;
+  }
+
+  if (RB_TYPE_P(obj, T_STRING)) {
+    long bytes = RSTRING_LEN(obj);
+
+    if (bytes % sizeof(double) != 0)
+      return "packed buffer length must be a multiple of 8 bytes (one native double per entry)";
+
+    buf->holder = rb_str_new_frozen(obj);
+    buf->len = bytes / (long)sizeof(double);
+    buf->ptr = (double *)RSTRING_PTR(buf->holder);
+
+    if (((uintptr_t)buf->ptr) % sizeof(double) != 0) {
+      VALUE unaligned = buf->holder;
+      buf->ptr = _alloc_doubles(buf->len, &buf->holder);
+      memcpy(buf->ptr, RSTRING_PTR(unaligned), bytes);
+      RB_GC_GUARD(unaligned);
+    }
+
+    return NULL;
+  }
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  if (rb_memory_view_available_p(obj)) {
+    // SIMPLE would ask for untyped bytes (a NULL format), so ask for the format we check below; there's no plain
+    // CONTIGUOUS flag, and for one dimension any contiguous layout is the one we want (the stride is checked too)
+    if (!rb_memory_view_get(obj, &buf->view, RUBY_MEMORY_VIEW_FORMAT | RUBY_MEMORY_VIEW_ANY_CONTIGUOUS))
+      return "couldn't get a contiguous memory view of the buffer";
+    buf->has_view = 1;
+
+    if (buf->view.ndim > 1 || buf->view.item_size != (ssize_t)sizeof(double) || buf->view.format == NULL || strcmp(buf->view.format, "d") != 0)
+      return "memory view must be a one-dimensional buffer of doubles (format \"d\")";
+
+    if (buf->view.byte_size % buf->view.item_size != 0 ||
+        (buf->view.ndim == 1 && buf->view.shape != NULL && buf->view.shape[0] != buf->view.byte_size / buf->view.item_size) ||
+        (buf->view.ndim == 1 && buf->view.strides != NULL && buf->view.strides[0] != buf->view.item_size))
+      return "memory view must hold its doubles contiguously, with a byte size that matches its length";
+
+    buf->holder = obj;
+    buf->len = buf->view.byte_size / buf->view.item_size;
+    buf->ptr = (double *)buf->view.data;
+
+    if (((uintptr_t)buf->ptr) % sizeof(double) != 0) {
+      // the view stays held (and released as usual); we just don't read the doubles in place
+      buf->ptr = _alloc_doubles(buf->len, &buf->holder);
+      memcpy(buf->ptr, buf->view.data, buf->len * sizeof(double));
+    }
+
+    return NULL;
+  }
+#endif
+
+  return "packed buffer must be a String of packed doubles, an object exporting a memory view of doubles, or an Array";
+}
+
+
+/* _release_double_buffer()
+ * internal function that gives back whatever _get_double_buffer() took; safe to call on a buffer that was never got,
+ * or whose _get_double_buffer() failed part way
+ */
+void _release_double_buffer(double_buffer *buf) {
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  if (buf->has_view)
+    rb_memory_view_release(&buf->view);
+#endif
+  RB_GC_GUARD(buf->holder);
+  memset(buf, 0, sizeof(*buf));
+}
@@ -2,6 +2,13 @@ require 'mkmf'
 
 $LOCAL_LIBS << '' # add libraries needed for compilation here
 
+# the SIMD clones of the PV kernels would otherwise fuse multiply-adds that the scalar code doesn't, and a loan's PV
+# would depend on which lane it landed in
+$CFLAGS << ' -ffp-contract=off'
+
+# the Monte Carlo paths are generated on several threads
+have_library('pthread', 'pthread_create')
+
 if RUBY_PLATFORM =~ /darwin/
   # $LDFLAGS << '-framework AppKit'
 end
@@ -0,0 +1,649 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <ruby.h>
+#include <ruby/thread.h>  // for rb_thread_call_without_gvl()
+#include "c_helper.h"
+
+/* monte_carlo.c
+ * CHelper.rate_paths, a native short-rate path generator (Hull-White or Vasicek) for path-wise pricing: paths come out
+ * of a counter-based RNG, so any path can be generated on its own, on any thread, and always comes out the same; the
+ * work is split across threads, and the paths land in one contiguous buffer, one libor vector per path
+ *
+ * and CHelper.backsolve_oas, which solves for the option-adjusted spread over a set of those paths
+ */
+
+
+
+/* _philox()
+ * internal function that is the Philox4x32-10 counter-based RNG (Salmon et al., "Parallel random numbers: as easy as
+ * 1, 2, 3"): ten rounds of multiplies and xors scramble a 128-bit counter under a 64-bit key into 128 random bits, so
+ * the draws for any (path, step) can be had directly, with no generator state to carry from one to the next
+ */
+static void _philox(uint32_t ctr[4], uint64_t seed) {
+  uint32_t key0 = (uint32_t)seed, key1 = (uint32_t)(seed >> 32), x0, x1, x2, x3;
+  uint64_t p0, p1;
+  int round;
+
+  x0 = ctr[0]; x1 = ctr[1]; x2 = ctr[2]; x3 = ctr[3];
+  for (round = 0; round < 10; round++) {
+    p0 = (uint64_t)0xD2511F53 * x0;
+    p1 = (uint64_t)0xCD9E8D57 * x2;
+    x0 = (uint32_t)(p1 >> 32) ^ x1 ^ key0;
+    x1 = (uint32_t)p1;
+    x2 = (uint32_t)(p0 >> 32) ^ x3 ^ key1;
+    x3 = (uint32_t)p0;
+    key0 += 0x9E3779B9;
+    key1 += 0xBB67AE85;
+  }
+  ctr[0] = x0; ctr[1] = x1; ctr[2] = x2; ctr[3] = x3;
+}
+
+
+/* _normal_pair()
+ * internal function that draws the two standard normals for path and pair (steps 2 * pair and 2 * pair + 1), by
+ * Box-Muller on two 53-bit uniforms from one Philox block
+ */
+static void _normal_pair(uint64_t seed, long path, long pair, double *z0, double *z1) {
+  uint32_t ctr[4] = { (uint32_t)pair, (uint32_t)((uint64_t)pair >> 32), (uint32_t)path, (uint32_t)((uint64_t)path >> 32) };
+  double u1, u2, radius;
+
+  _philox(ctr, seed);
+  u1 = ((((uint64_t)ctr[0] << 32 | ctr[1]) >> 11) + 1.0) / 9007199254740992.0;  // (0, 1], so the log is finite
+  u2 = (((uint64_t)ctr[2] << 32 | ctr[3]) >> 11) / 9007199254740992.0;          // [0, 1)
+  radius = sqrt(-2.0 * log(u1));
+  *z0 = radius * cos(2.0 * M_PI * u2);
+  *z1 = radius * sin(2.0 * M_PI * u2);
+}
+
+
+/* _rate_model()
+ * internal function that discretizes a one-factor short-rate model on a loan's dates, filling in model's drift, decay
+ * and stdev (room for num_periods each); libor for period t is the short rate at the start of the period, i.e. at
+ * s = dates[t - 1] / year_convention years (0 for the first), written r(s) = phi(s) + x(s), where x is an
+ * Ornstein-Uhlenbeck process with mean reversion a and volatility sigma starting at 0, stepped exactly from one date
+ * to the next
+ *  - CH_HULL_WHITE fits phi to the initial forward curve: phi(s) = f(s) + sigma^2 / (2 a^2) * (1 - e^(-a s))^2, with
+ *    f(s) taken as forwards[t], so that the paths average out to the forwards plus their convexity
+ *  - CH_VASICEK reverts from forwards[0] towards mean: phi(s) = mean + (forwards[0] - mean) * e^(-a s)
+ * a of 0 is allowed (Ho-Lee and a driftless random walk, respectively)
+ */
+void _rate_model(int model, double *dates, double *forwards, long num_periods, double a, double sigma, double mean, double year_convention, ch_rate_model *rate_model) {
+  double s, prev_s = 0.0, dt;
+  long t;
+
+  rate_model->num_periods = num_periods;
+  for (t = 0; t < num_periods; t++) {
+    s = t > 0 ? dates[t - 1] / year_convention : 0.0;
+    dt = s - prev_s;
+
+    if (model == CH_VASICEK)
+      rate_model->drift[t] = a > 1e-12 ? mean + (forwards[0] - mean) * exp(-a * s) : forwards[0];
+    else
+      rate_model->drift[t] = forwards[t] + (a > 1e-12 ? sigma * sigma / (2.0 * a * a) * pow(1.0 - exp(-a * s), 2.0) : sigma * sigma * s * s / 2.0);
+
+    rate_model->decay[t] = exp(-a * dt);
+    rate_model->stdev[t] = sigma * sqrt(a > 1e-12 ? (1.0 - exp(-2.0 * a * dt)) / (2.0 * a) : dt);
+    prev_s = s;
+  }
+}
+
+
+/* _rate_path()
+ * internal function that generates path number path of rate_model into rates (room for num_periods); the draws
+ * depend only on the seed, the path number and the step, so a path is the same whichever thread generates it
+ */
+void _rate_path(ch_rate_model *rate_model, long path, double *rates) {
+  double x = 0.0, z[2];
+  long t;
+
+  for (t = 0; t < rate_model->num_periods; t++) {
+    if (t % 2 == 0)
+      _normal_pair(rate_model->seed, path, t / 2, &z[0], &z[1]);
+    x = x * rate_model->decay[t] + rate_model->stdev[t] * z[t % 2];
+    rates[t] = rate_model->drift[t] + x;
+  }
+}
+
+
+typedef struct parallel_pool parallel_pool;
+
+typedef struct {
+  parallel_pool *pool;
+  int index;  // which slice this thread runs
+} pool_worker;
+
+/* parallel_pool
+ * num_threads - 1 worker threads, started once and then handed round after round of work, each round split into
+ * num_threads contiguous slices of [0, n) with the last slices (any whose worker couldn't be started too) run on the
+ * calling thread; see _pool_start()
+ */
+struct parallel_pool {
+  void (*fn)(void *ctx, long begin, long end);
+  void *ctx;
+  long n;
+  int num_threads, num_started;
+  pthread_t threads[CH_MAX_THREADS];
+  pool_worker workers[CH_MAX_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t go, done;
+  long round;    // bumped to start each round
+  int pending;   // workers still busy with this round
+  char stopping;
+};
+
+static void _run_slice(parallel_pool *pool, int index) {
+  long begin = pool->n * index / pool->num_threads, end = pool->n * (index + 1) / pool->num_threads;
+  if (begin < end)
+    pool->fn(pool->ctx, begin, end);
+}
+
+static void *_run_pool_worker(void *data) {
+  pool_worker *worker = (pool_worker *)data;
+  parallel_pool *pool = worker->pool;
+  long seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->round == seen && !pool->stopping)
+      pthread_cond_wait(&pool->go, &pool->lock);
+    if (pool->stopping) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->round;
+    pthread_mutex_unlock(&pool->lock);
+
+    _run_slice(pool, worker->index);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0)
+      pthread_cond_signal(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+
+/* _pool_start()
+ * internal function that starts the workers for splitting n items across num_threads threads (capped at
+ * CH_MAX_THREADS, and at n); if a thread can't be started, its slice and the ones after it run on the calling thread
+ */
+static void _pool_start(parallel_pool *pool, long n, int num_threads) {
+  int i;
+
+  if (num_threads > CH_MAX_THREADS) num_threads = CH_MAX_THREADS;
+  if (num_threads > n) num_threads = (int)n;
+  if (num_threads < 1) num_threads = 1;
+
+  pool->n = n;
+  pool->num_threads = num_threads;
+  pool->num_started = 0;
+  pool->round = 0;
+  pool->pending = 0;
+  pool->stopping = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->go, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (i = 0; i < num_threads - 1; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    if (pthread_create(&pool->threads[i], NULL, _run_pool_worker, &pool->workers[i]) != 0)
+      break;
+    pool->num_started++;
+  }
+}
+
+
+/* _pool_run()
+ * internal function that calls fn(ctx, begin, end) on every slice, one per thread, and returns once they're all done
+ *
+ * fn must not touch the Ruby API
+ */
+static void _pool_run(parallel_pool *pool, void (*fn)(void *ctx, long begin, long end), void *ctx) {
+  int i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->ctx = ctx;
+  pool->pending = pool->num_started;
+  pool->round++;
+  pthread_cond_broadcast(&pool->go);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = pool->num_started; i < pool->num_threads; i++)
+    _run_slice(pool, i);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+/* _pool_stop()
+ * internal function that winds the workers down once the last round is done
+ */
+static void _pool_stop(parallel_pool *pool) {
+  int i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->go);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < pool->num_started; i++)
+    pthread_join(pool->threads[i], NULL);
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->go);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+
+/* _parallel_for()
+ * internal function that calls fn(ctx, begin, end) on num_threads contiguous slices of [0, n), one per thread, with
+ * the last slice on the calling thread, and returns once they're all done; a one-round _pool_start() / _pool_run()
+ *
+ * fn must not touch the Ruby API; num_threads is capped at CH_MAX_THREADS
+ */
+void _parallel_for(long n, int num_threads, void (*fn)(void *ctx, long begin, long end), void *ctx) {
+  parallel_pool pool;
+
+  if (num_threads <= 1 || n <= 1) {
+    if (n > 0)
+      fn(ctx, 0, n);
+    return;
+  }
+
+  _pool_start(&pool, n, num_threads);
+  _pool_run(&pool, fn, ctx);
+  _pool_stop(&pool);
+}
+
+
+/* _default_threads()
+ * internal function that is how many threads to use when the caller doesn't say: one per online CPU
+ */
+int _default_threads(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus < 1 ? 1 : cpus > CH_MAX_THREADS ? CH_MAX_THREADS : (int)cpus;
+}
+
+
+typedef struct {
+  double *cfs, *dates;
+  long num_cfs;
+  double *paths, *paths_t;  // path after path as passed in, and transposed (path-fastest) for _compute_pv_paths()
+  long num_paths;
+  double target_px;
+  char is_clean;
+  double accrued_interest, year_convention;
+  parallel_pool *pool;  // the threads every evaluation is split across
+
+  double spread;       // the spread being tried
+  double *pvs, *dpvs;  // and each path's PV, and derivative when Newton wants one (otherwise dpvs is NULL)
+} oas_objective;
+
+static void _transpose_paths_chunk(void *ctx, long begin, long end) {
+  oas_objective *o = (oas_objective *)ctx;
+  long p, t;
+
+  for (p = begin; p < end; p++)
+    for (t = 0; t < o->num_cfs; t++)
+      o->paths_t[t * o->num_paths + p] = o->paths[p * o->num_cfs + t];
+}
+
+static void _oas_pv_chunk(void *ctx, long begin, long end) {
+  oas_objective *o = (oas_objective *)ctx;
+  _compute_pv_paths(o->cfs, o->dates, o->paths_t + begin, o->num_paths, o->num_cfs, end - begin, o->year_convention, o->spread,
+    o->pvs + begin, o->dpvs != NULL ? o->dpvs + begin : NULL);
+}
+
+/* _oas_objective()
+ * internal function that is the objective for _solve(): target_px less the mean PV over the paths at spread, each
+ * thread pricing a slice of the paths with _compute_pv_paths(); the mean is then taken in path order, so the result
+ * doesn't depend on how many threads there were
+ */
+static double _oas_objective(void *data, double spread, double *deriv) {
+  oas_objective *o = (oas_objective *)data;
+  double sum_pv = 0.0, sum_dpv = 0.0, pv;
+  long p;
+
+  o->spread = spread;
+  o->dpvs = deriv != NULL ? o->pvs + o->num_paths : NULL;
+  _pool_run(o->pool, _oas_pv_chunk, o);
+
+  for (p = 0; p < o->num_paths; p++)
+    sum_pv += o->pvs[p];
+  pv = sum_pv / o->num_paths;
+  if (o->is_clean)
+    pv -= o->accrued_interest;
+
+  if (deriv != NULL) {
+    for (p = 0; p < o->num_paths; p++)
+      sum_dpv += o->dpvs[p];
+    *deriv = -sum_dpv / o->num_paths;
+  }
+  return o->target_px - pv;
+}
+
+
+/* _backsolve_oas()
+ * internal function that uses _solve() to find the option-adjusted spread: the one spread over every path that gets
+ * the mean path PV to target_px. paths holds num_paths libor vectors of num_cfs each, one after the other (as
+ * CHelper.rate_paths lays them out); each evaluation prices every path, split across num_threads threads and
+ * vectorized across paths within each. The threads are started once for the whole solve and handed each evaluation in
+ * turn (see _pool_run()), so an evaluation costs no thread creation
+ *
+ * scratch needs room for num_paths * (num_cfs + 2) doubles: the paths transposed, then a PV and a derivative per path
+ *
+ * returns the spread, or a sentinel as _backsolve_cf() does
+ */
+double _backsolve_oas(double *cfs, double *dates, double *paths, long num_cfs, long num_paths, double target_px, char is_clean, double accrued_interest, double year_convention, int num_threads, double *scratch, solver_opts *opts) {
+  parallel_pool pool;
+  oas_objective o = { cfs, dates, num_cfs, paths, scratch, num_paths, target_px, is_clean, accrued_interest, year_convention, &pool,
+    0.0, scratch + num_paths * num_cfs, NULL };
+  double x_min = -HUGE_VAL, prev_cumul_date = 0.0, max_rate, result;
+  long t, p;
+
+  if (num_cfs < 1 || num_paths < 1) {
+    opts->iterations = 0;
+    opts->residual = NAN;
+    return CH_NO_CASH_FLOWS;
+  }
+
+  _pool_start(&pool, num_paths, num_threads);
+  _pool_run(&pool, _transpose_paths_chunk, &o);
+
+  // as in _backsolve_cf(), below this spread some 1 + r * tau denominator on some path goes through 0
+  if (opts->method == CH_BRENT) {
+    for (t = 0; t < num_cfs; t++) {
+      if (dates[t] > prev_cumul_date) {
+        max_rate = -HUGE_VAL;
+        for (p = 0; p < num_paths; p++)
+          max_rate = fmax(max_rate, -o.paths_t[t * num_paths + p]);
+        x_min = fmax(x_min, max_rate - year_convention / (dates[t] - prev_cumul_date));
+      }
+      prev_cumul_date = dates[t];
+    }
+  }
+
+  result = _solve(_oas_objective, &o, x_min, opts);
+  _pool_stop(&pool);
+  return result;
+}
+
+
+typedef struct {
+  ch_rate_model model;
+  long num_paths;
+  double *paths;
+  int num_threads;
+  volatile int interrupted;
+} rate_paths_job;
+
+static void _rate_paths_chunk(void *ctx, long begin, long end) {
+  rate_paths_job *job = (rate_paths_job *)ctx;
+  long p;
+
+  for (p = begin; p < end && !job->interrupted; p++)
+    _rate_path(&job->model, p, job->paths + p * job->model.num_periods);
+}
+
+static void *_run_rate_paths_job(void *data) {
+  rate_paths_job *job = (rate_paths_job *)data;
+  _parallel_for(job->num_paths, job->num_threads, _rate_paths_chunk, job);
+  return NULL;
+}
+
+static void _unblock_rate_paths_job(void *data) {
+  ((rate_paths_job *)data)->interrupted = 1;
+}
+
+
+/* _get_threads()
+ * internal function that reads a threads: option, defaulting to _default_threads()
+ */
+int _get_threads(VALUE threads) {
+  if (threads == Qundef || NIL_P(threads))
+    return _default_threads();
+  Check_Type(threads, T_FIXNUM);
+  if (FIX2LONG(threads) < 1)
+    rb_raise(rb_eArgError, "threads must be > 0");
+  return FIX2LONG(threads) > CH_MAX_THREADS ? CH_MAX_THREADS : (int)FIX2LONG(threads);
+}
+
+
+/* rate_paths
+ * exported function that simulates num_paths short-rate paths over a loan's dates and returns them as a packed String
+ * of doubles (as Array#pack('d*') would give), path after path, num_paths * dates.size in all: entry
+ * p * dates.size + t is path p's libor for period t, so each path is a libor vector the pricing kernels take as is
+ *
+ * CHelper.rate_paths(dates, libor, num_paths, mean_reversion, volatility, year_convention, model: :hull_white,
+ *                    mean: nil, seed: 0, threads: nil)
+ *
+ * dates are the loan's payment dates, checked as in backsolve_cf; libor (an Array, a packed buffer or a
+ * CHelper::Curve) is the initial forward curve a :hull_white model is fitted to, while a :vasicek model starts at
+ * libor[0] and reverts to mean: (libor[0] if not given); see _rate_model(). The same seed always gives the same paths,
+ * however many threads: (one per CPU by default) generate them, and the generation runs without the GVL
+ */
+VALUE rate_paths(int argc, VALUE *argv, VALUE _self) {
+  VALUE dates, libor, num_paths, mean_reversion, volatility, year_convention, kwargs;
+  VALUE kw_values[4] = { Qundef, Qundef, Qundef, Qundef };
+  ID kw_ids[4];
+
+  rb_scan_args(argc, argv, "6:", &dates, &libor, &num_paths, &mean_reversion, &volatility, &year_convention, &kwargs);
+  Check_Type(num_paths,         T_FIXNUM);
+  Check_Type(mean_reversion,    T_FLOAT);
+  Check_Type(volatility,        T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+  if (!NIL_P(kwargs)) {
+    kw_ids[0] = rb_intern("model");
+    kw_ids[1] = rb_intern("mean");
+    kw_ids[2] = rb_intern("seed");
+    kw_ids[3] = rb_intern("threads");
+    rb_get_kwargs(kwargs, kw_ids, 0, 4, kw_values);
+  }
+
+  int model = CH_HULL_WHITE;
+  if (kw_values[0] == Qundef || kw_values[0] == ID2SYM(rb_intern("hull_white")))
+    model = CH_HULL_WHITE;
+  else if (kw_values[0] == ID2SYM(rb_intern("vasicek")))
+    model = CH_VASICEK;
+  else
+    rb_raise(rb_eArgError, "unknown model %"PRIsVALUE" (expected :hull_white or :vasicek)", kw_values[0]);
+  if (kw_values[1] != Qundef && !NIL_P(kw_values[1])) Check_Type(kw_values[1], T_FLOAT);
+  if (kw_values[2] != Qundef) Check_Type(kw_values[2], T_FIXNUM);
+
+  long c_num_paths = FIX2LONG(num_paths);
+  if (c_num_paths < 0)
+    rb_raise(rb_eArgError, "num_paths must be >= 0");
+  if (NUM2DBL(mean_reversion) < 0.0 || NUM2DBL(volatility) < 0.0)
+    rb_raise(rb_eArgError, "mean_reversion and volatility must be >= 0");
+  int num_threads = _get_threads(kw_values[3]);
+
+  double_buffer c_dates = DOUBLE_BUFFER_INIT, c_libor = DOUBLE_BUFFER_INIT;
+  const char *err;
+  long t, n;
+
+  if ((err = _get_double_buffer(dates, &c_dates)) != NULL || (err = _get_libor_buffer(libor, c_dates.ptr, c_dates.len, &c_libor)) != NULL) {
+    _release_double_buffer(&c_dates);
+    _release_double_buffer(&c_libor);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+  n = c_dates.len;
+  if (n < 1)
+    err = "valid array of dates must have at least one entry";
+  else if (c_libor.len != n)
+    err = "dates and libor must have the same number of entries";
+  for (t = 0; err == NULL && t < n; t++)
+    if (c_dates.ptr[t] <= (t > 0 ? c_dates.ptr[t - 1] : 0.0))
+      err = "dates must contain a list of monotonically increasing values, starting at a value > 0";
+  if (err != NULL) {
+    _release_double_buffer(&c_dates);
+    _release_double_buffer(&c_libor);
+    rb_raise(rb_eRuntimeError, "%s", err);
+  }
+
+  VALUE model_holder, paths_holder = Qnil;
+  double *model_buf = _alloc_doubles(3 * n, &model_holder);
+  rate_paths_job job = { { model_buf, model_buf + n, model_buf + 2 * n, n,
+    kw_values[2] != Qundef ? (uint64_t)FIX2LONG(kw_values[2]) : 0 }, c_num_paths };
+  _rate_model(model, c_dates.ptr, c_libor.ptr, n, NUM2DBL(mean_reversion), NUM2DBL(volatility),
+    kw_values[1] != Qundef && !NIL_P(kw_values[1]) ? NUM2DBL(kw_values[1]) : c_libor.ptr[0], NUM2DBL(year_convention), &job.model);
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_libor);
+
+  // the paths are written straight into the String we return, unless it isn't aligned for doubles (only ever the
+  // case for a tiny one embedded in its object)
+  VALUE result = rb_str_new(NULL, c_num_paths * n * sizeof(double));
+  job.paths = (double *)RSTRING_PTR(result);
+  if (((uintptr_t)job.paths) % sizeof(double) != 0)
+    job.paths = _alloc_doubles(c_num_paths * n, &paths_holder);
+  job.num_threads = num_threads;
+
+  // generation is deterministic, so if servicing an interrupt doesn't raise, just start over
+  do {
+    job.interrupted = 0;
+    rb_thread_call_without_gvl(_run_rate_paths_job, &job, _unblock_rate_paths_job, &job);
+  } while (job.interrupted);
+
+  if (job.paths != (double *)RSTRING_PTR(result))
+    memcpy(RSTRING_PTR(result), job.paths, c_num_paths * n * sizeof(double));
+
+  RB_GC_GUARD(model_holder);
+  RB_GC_GUARD(paths_holder);
+  return result;
+}
+
+
+typedef struct {
+  double *cfs, *dates, *paths;
+  long num_cfs, num_paths;
+  double target_px;
+  char is_clean;
+  double accrued_interest, year_convention;
+  int num_threads;
+  double *scratch;
+  solver_opts opts;
+  double result;
+  volatile int interrupted;
+} oas_job;
+
+static void *_run_oas_job(void *data) {
+  oas_job *job = (oas_job *)data;
+  job->opts.interrupted = &job->interrupted;
+  job->result = _backsolve_oas(job->cfs, job->dates, job->paths, job->num_cfs, job->num_paths, job->target_px, job->is_clean,
+    job->accrued_interest, job->year_convention, job->num_threads, job->scratch, &job->opts);
+  return NULL;
+}
+
+static void _unblock_oas_job(void *data) {
+  ((oas_job *)data)->interrupted = 1;
+}
+
+static VALUE _call_oas_job(VALUE data) {
+  oas_job *job = (oas_job *)data;
+
+  // an interrupted solve is simply rerun if servicing the interrupt didn't raise
+  do {
+    job->interrupted = 0;
+    rb_thread_call_without_gvl(_run_oas_job, job, _unblock_oas_job, job);
+  } while (job->result == CH_INTERRUPTED);
+
+  return Qnil;
+}
+
+/* backsolve_oas
+ * exported function that backsolves the option-adjusted spread: the constant spread over every rate path that makes
+ * the loan's mean PV across the paths equal target_px (see _backsolve_oas())
+ *
+ * CHelper.backsolve_oas(cfs, dates, paths, target_px, res, max_tries, is_clean, accrued_interest, year_convention,
+ *                       method: :secant, guess: nil, exception: true, threads: nil)
+ *
+ * cfs and dates are taken as in backsolve_cf_packed; paths is a packed buffer (or an Array) of libor paths, one
+ * after the other with one entry per cash flow, e.g. straight from CHelper.rate_paths. method:, guess: and exception:
+ * are as for backsolve_cf, and threads: as for rate_paths; the solve runs without the GVL
+ *
+ * assumes that is_clean is a boolean True or False
+ */
+VALUE backsolve_oas(int argc, VALUE *argv, VALUE _self) {
+  long started = _clock_ns();
+  VALUE kwargs = _split_kwargs(&argc, argv, 9);
+  VALUE cfs = argv[0];
+  VALUE dates = argv[1];
+  VALUE paths = argv[2];
+  VALUE target_px = argv[3];
+  VALUE res = argv[4];
+  VALUE max_tries = argv[5];
+  VALUE is_clean = argv[6];
+  VALUE accrued_interest = argv[7];
+  VALUE year_convention = argv[8];
+  Check_Type(target_px,         T_FLOAT);
+  Check_Type(res,               T_FLOAT);
+  Check_Type(max_tries,         T_FIXNUM);
+  Check_Type(accrued_interest,  T_FLOAT);
+  Check_Type(year_convention,   T_FLOAT);
+
+  // threads: and exception: are ours; method: and guess: go through _get_solver_opts() as usual
+  VALUE solver_kwargs = Qnil, threads = Qundef;
+  if (!NIL_P(kwargs)) {
+    solver_kwargs = rb_hash_dup(kwargs);
+    threads = rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("threads")));
+    rb_hash_delete(solver_kwargs, ID2SYM(rb_intern("exception")));
+  }
+  solver_opts opts = _get_solver_opts(res, max_tries, solver_kwargs, NO_CACHE);
+  int num_threads = _get_threads(threads);
+
+  double_buffer c_cfs = DOUBLE_BUFFER_INIT, c_dates = DOUBLE_BUFFER_INIT, c_paths = DOUBLE_BUFFER_INIT;
+  double_buffer *bufs[3] = { &c_cfs, &c_dates, NULL };
+  const char *err;
+  _get_packed_inputs(cfs, dates, Qnil, bufs, 1);
+
+  if ((err = _get_double_buffer(paths, &c_paths)) == NULL && (c_paths.len < 1 || c_paths.len % c_cfs.len != 0))
+    err = "paths must hold at least one path, with one entry per cash flow in each";
+  if (err != NULL) {
+    _release_double_buffer(&c_cfs);
+    _release_double_buffer(&c_dates);
+    _release_double_buffer(&c_paths);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  VALUE scratch_holder;
+  long num_paths = c_paths.len / c_cfs.len;
+  oas_job job = { c_cfs.ptr, c_dates.ptr, c_paths.ptr, c_cfs.len, num_paths,
+    NUM2DBL(target_px),
+    TYPE(is_clean) == T_TRUE ? 1 : 0,
+    NUM2DBL(accrued_interest),
+    NUM2DBL(year_convention),
+    num_threads,
+    _alloc_doubles(num_paths * (c_cfs.len + 2), &scratch_holder),
+    opts };
+  long solve_started = _clock_ns();
+  int state = 0;
+  rb_protect(_call_oas_job, (VALUE)&job, &state);
+
+  _release_double_buffer(&c_cfs);
+  _release_double_buffer(&c_dates);
+  _release_double_buffer(&c_paths);
+  RB_GC_GUARD(scratch_holder);
+
+  // a solve that was interrupted by a raise never finished, so only its time counts, as in _run_solve_job()
+  solver_stats stats = { 0 };
+  if (job.result != CH_INTERRUPTED)
+    _count_solve(&stats, job.result, &job.opts);
+  _record_stats(&stats, started, solve_started, _clock_ns());
+
+  if (state)
+    rb_jump_tag(state);
+
+  return _solver_result(kwargs, job.result, &job.opts, NULL);
+}
+
+
+void Init_monte_carlo(VALUE mod) {
+  rb_define_module_function(mod, "rate_paths", rate_paths, -1);
+  rb_define_module_function(mod, "backsolve_oas", backsolve_oas, -1);
+}
\ No newline at end of file
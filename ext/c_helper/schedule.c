@@ -0,0 +1,352 @@
+#include <ruby.h>
+#include <ruby/thread.h>  // for rb_thread_call_without_gvl()
+#include "c_helper.h"
+
+/* schedule.c
+ * coupon schedules generated natively: the payment dates of a loan from its effective and termination dates and its
+ * frequency, with a front or back stub, end-of-month rolls and business-day adjustment against a CHelper::Calendar,
+ * plus each period's year fraction under a day count. Dates are serials, as in day_count.c, and a whole portfolio's
+ * schedules come back as one packed buffer per loan, with no Ruby object per date
+ */
+
+
+
+/* _add_months()
+ * internal function that moves a serial date by months (either way), keeping its day of the month where the new month
+ * has it and taking the last day otherwise; with end_of_month set, a date on the last day of its month stays on the
+ * last day
+ */
+static long _add_months(long serial, long months, char end_of_month) {
+  long year, month, day, m0, years, days_in_new_month;
+  int month_end;
+
+  _civil_from_serial(serial, &year, &month, &day);
+  month_end = day == _days_in_month(year, month);
+
+  m0 = month - 1 + months;
+  years = m0 >= 0 ? m0 / 12 : -((11 - m0) / 12);
+  year += years;
+  month = m0 - 12 * years + 1;
+
+  days_in_new_month = _days_in_month(year, month);
+  if (day > days_in_new_month || (end_of_month && month_end))
+    day = days_in_new_month;
+  return _serial_from_civil(year, month, day);
+}
+
+
+/* _schedule_max_periods()
+ * internal function that gives how much room _schedule() could need for a schedule, so batches can be laid out before
+ * any is generated
+ */
+long _schedule_max_periods(long effective, long termination, long frequency) {
+  long y1, m1, y2, m2, d;
+
+  if (termination <= effective)
+    return 1;
+  _civil_from_serial(effective, &y1, &m1, &d);
+  _civil_from_serial(termination, &y2, &m2, &d);
+  return ((y2 - y1) * 12 + (m2 - m1)) / (12 / frequency) + 2;
+}
+
+
+/* _schedule()
+ * internal function that generates a schedule into dates (the payment dates) and year_fractions (each period's
+ * accrual, from the date before it, or effective for the first); returns the number of periods
+ *
+ * the regular dates are counted in steps of 12 / frequency months from termination back towards effective for a front
+ * stub, or from effective forward towards termination for a back stub, each computed from that anchor rather than
+ * from the date before it, so a 31st that has had to become a 30th or a 28th goes back to the 31st when it can. When
+ * the steps don't land exactly on the other end, what's left over is the stub: CH_SHORT_FRONT and CH_SHORT_BACK leave
+ * it as a short period of its own, CH_LONG_FRONT and CH_LONG_BACK fold it into the regular period next to it
+ *
+ * each date (effective and termination included) is then rolled under rules->roll if there's a calendar, and the
+ * year fractions are taken between the rolled dates. A period that rolling leaves empty (its end rolled onto or before
+ * the rolled date before it, e.g. a Saturday effective and a Sunday first payment both landing on the Monday) is folded
+ * into its neighbour the way the stub is: into the next period, or for the last one, the previous period, so the dates
+ * stay strictly increasing as the _compute_pv() family needs. Returns 0 if effective and termination themselves roll
+ * onto the same day
+ *
+ * assumes that frequency divides 12, that termination > effective and that dates and year_fractions have room for
+ * _schedule_max_periods()
+ */
+long _schedule(ch_schedule_rules *rules, long effective, long termination, long frequency, double *dates, double *year_fractions) {
+  long step = 12 / frequency, num_regular, num_periods, k, t, w, start, prev, adjusted;
+  char backward = rules->stub == CH_SHORT_FRONT || rules->stub == CH_LONG_FRONT;
+  char long_stub = rules->stub == CH_LONG_FRONT || rules->stub == CH_LONG_BACK;
+  long anchor = backward ? termination : effective, direction = backward ? -1 : 1, end = backward ? effective : termination;
+
+  // how many regular dates fall strictly between the two ends, and whether the last step lands exactly on the far one
+  for (k = 1; ; k++) {
+    long d = _add_months(anchor, direction * k * step, rules->end_of_month);
+    if (backward ? d <= effective : d >= termination) {
+      num_regular = k - 1;
+      if (d != end && long_stub && num_regular > 0)
+        num_regular--;
+      break;
+    }
+  }
+
+  num_periods = num_regular + 1;
+  for (t = 0; t < num_regular; t++)
+    dates[t] = (double)_add_months(anchor, backward ? -(num_regular - t) * step : (t + 1) * step, rules->end_of_month);
+  dates[num_periods - 1] = (double)termination;
+
+  start = rules->calendar != NULL ? _adjust_date(rules->calendar, effective, rules->roll) : effective;
+  prev = start;
+  for (t = 0, w = 0; t < num_periods; t++) {
+    adjusted = rules->calendar != NULL ? _adjust_date(rules->calendar, (long)dates[t], rules->roll) : (long)dates[t];
+    if (adjusted <= prev) {
+      if (t < num_periods - 1)
+        continue;   // an empty period before termination: the next one starts where it would have
+      if (w == 0)
+        return 0;   // the whole schedule rolled away
+      prev = --w > 0 ? (long)dates[w - 1] : start;  // an empty last period: the one before runs to termination
+    }
+    year_fractions[w] = _year_fraction((double)prev, (double)adjusted, rules->day_count);
+    dates[w++] = (double)adjusted;
+    prev = adjusted;
+  }
+
+  return w;
+}
+
+
+/* _get_schedule_rules()
+ * internal function that reads the keyword options schedule and schedule_batch share:
+ *  - stub: :short_front (the default), :long_front, :short_back or :long_back
+ *  - end_of_month: true to keep dates anchored on the last day of a month on the last day of every month
+ *  - calendar: a CHelper::Calendar to roll the dates against; with none, they're left unadjusted
+ *  - roll: how to roll them, as for Calendar#adjust; :modified_following by default
+ *  - day_count: for the year fractions, as for year_fraction; :act_365f by default
+ *
+ * rules.calendar points into the Calendar, so the Calendar itself comes back in *calendar (Qnil if there's none) for
+ * the caller to RB_GC_GUARD() until it's done with the rules
+ */
+static ch_schedule_rules _get_schedule_rules(VALUE kwargs, VALUE *calendar) {
+  ch_schedule_rules rules = { CH_SHORT_FRONT, 0, NULL, CH_MODIFIED_FOLLOWING, CH_ACT_365F };
+  ID keys[5];
+  VALUE values[5];
+
+  *calendar = Qnil;
+  if (NIL_P(kwargs))
+    return rules;
+
+  keys[0] = rb_intern("stub");
+  keys[1] = rb_intern("end_of_month");
+  keys[2] = rb_intern("calendar");
+  keys[3] = rb_intern("roll");
+  keys[4] = rb_intern("day_count");
+  rb_get_kwargs(kwargs, keys, 0, 5, values);
+
+  if (values[0] != Qundef && !NIL_P(values[0])) {
+    if (values[0] == ID2SYM(rb_intern("short_front")))
+      rules.stub = CH_SHORT_FRONT;
+    else if (values[0] == ID2SYM(rb_intern("long_front")))
+      rules.stub = CH_LONG_FRONT;
+    else if (values[0] == ID2SYM(rb_intern("short_back")))
+      rules.stub = CH_SHORT_BACK;
+    else if (values[0] == ID2SYM(rb_intern("long_back")))
+      rules.stub = CH_LONG_BACK;
+    else
+      rb_raise(rb_eArgError, "unknown stub %"PRIsVALUE" (expected :short_front, :long_front, :short_back or :long_back)", values[0]);
+  }
+  if (values[1] != Qundef)
+    rules.end_of_month = RTEST(values[1]) ? 1 : 0;
+  if (values[2] != Qundef && !NIL_P(values[2])) {
+    if ((rules.calendar = _get_calendar(values[2])) == NULL)
+      rb_raise(rb_eArgError, "calendar must be a CHelper::Calendar");
+    *calendar = values[2];
+  }
+  if (values[3] != Qundef && !NIL_P(values[3]))
+    rules.roll = _get_roll(values[3]);
+  if (values[4] != Qundef)
+    rules.day_count = _get_day_count(values[4]);
+
+  return rules;
+}
+
+
+static long _get_frequency(VALUE frequency) {
+  long c_frequency = NUM2LONG(frequency);
+  if (c_frequency < 1 || c_frequency > 12 || 12 % c_frequency != 0)
+    rb_raise(rb_eArgError, "frequency must be 1, 2, 3, 4, 6 or 12 payments a year");
+  return c_frequency;
+}
+
+
+/* schedule
+ * exported function that generates one loan's schedule (see _schedule()):
+ *
+ * CHelper.schedule(effective, termination, frequency, stub: :short_front, end_of_month: false, calendar: nil,
+ *                  roll: :modified_following, day_count: :act_365f)
+ *
+ * effective and termination are serial dates (Date#jd), and frequency is payments a year. Returns [dates,
+ * year_fractions], both packed Strings of doubles: the dates can go to accrual_dates for the _compute_pv family, and
+ * the year fractions are what each period's coupon accrues over
+ */
+VALUE schedule(int argc, VALUE *argv, VALUE _self) {
+  VALUE effective, termination, frequency, kwargs, calendar, dates_holder, year_fractions_holder;
+  rb_scan_args(argc, argv, "3:", &effective, &termination, &frequency, &kwargs);
+  ch_schedule_rules rules = _get_schedule_rules(kwargs, &calendar);
+  long c_effective = NUM2LONG(effective), c_termination = NUM2LONG(termination), c_frequency = _get_frequency(frequency);
+
+  if (c_termination <= c_effective)
+    rb_raise(rb_eRuntimeError, "termination must be after effective");
+
+  long max_periods = _schedule_max_periods(c_effective, c_termination, c_frequency);
+  double *dates = _alloc_doubles(max_periods, &dates_holder);
+  double *year_fractions = _alloc_doubles(max_periods, &year_fractions_holder);
+  long num_periods = _schedule(&rules, c_effective, c_termination, c_frequency, dates, year_fractions);
+  if (num_periods == 0)
+    rb_raise(rb_eRuntimeError, "effective and termination roll onto the same business day");
+
+  VALUE result = rb_assoc_new(rb_str_new((const char *)dates, num_periods * sizeof(double)),
+    rb_str_new((const char *)year_fractions, num_periods * sizeof(double)));
+  RB_GC_GUARD(calendar);  // rules.calendar points into it
+  RB_GC_GUARD(dates_holder);
+  RB_GC_GUARD(year_fractions_holder);
+  return result;
+}
+
+
+typedef struct {
+  ch_schedule_rules rules;
+  double *effective, *termination;
+  long *frequency, num_loans;
+  long *offsets;       // where loan i's room (_schedule_max_periods()) starts in dates and year_fractions
+  long *num_periods;   // out
+  double *dates, *year_fractions;
+
+  long next_loan;      // where to pick up again after an interrupt
+  volatile int interrupted;
+} schedule_batch_job;
+
+static void *_run_schedule_batch_job(void *data) {
+  schedule_batch_job *job = (schedule_batch_job *)data;
+  long i;
+
+  for (; job->next_loan < job->num_loans && !job->interrupted; job->next_loan++) {
+    i = job->next_loan;
+    job->num_periods[i] = _schedule(&job->rules, (long)job->effective[i], (long)job->termination[i], job->frequency[i],
+      job->dates + job->offsets[i], job->year_fractions + job->offsets[i]);
+  }
+
+  return NULL;
+}
+
+static void _unblock_schedule_batch_job(void *data) {
+  ((schedule_batch_job *)data)->interrupted = 1;
+}
+
+
+/* schedule_batch
+ * exported function that is schedule for a whole portfolio at once:
+ *
+ * CHelper.schedule_batch(effectives, terminations, frequencies, **options)
+ *
+ * effectives and terminations have one serial date per loan (Arrays or packed buffers of doubles), frequencies is
+ * either one frequency for every loan or one per loan, and the keyword options are schedule's, shared by every loan.
+ * Returns [dates_list, year_fractions_list], an Array each with one packed String per loan, laid out as schedule
+ * returns them. The schedules are generated without the GVL
+ */
+VALUE schedule_batch(int argc, VALUE *argv, VALUE _self) {
+  VALUE effectives, terminations, frequencies, kwargs, calendar;
+  rb_scan_args(argc, argv, "3:", &effectives, &terminations, &frequencies, &kwargs);
+  ch_schedule_rules rules = _get_schedule_rules(kwargs, &calendar);
+
+  double_buffer c_effectives = DOUBLE_BUFFER_INIT, c_terminations = DOUBLE_BUFFER_INIT, c_frequencies = DOUBLE_BUFFER_INIT;
+  const char *err = NULL;
+  VALUE err_class = rb_eArgError;
+  char shared_frequency = RB_INTEGER_TYPE_P(frequencies);
+  long i, c_frequency = shared_frequency ? _get_frequency(frequencies) : 0;
+
+  if ((err = _get_double_buffer(effectives, &c_effectives)) != NULL || (err = _get_double_buffer(terminations, &c_terminations)) != NULL ||
+      (!shared_frequency && (err = _get_double_buffer(frequencies, &c_frequencies)) != NULL)) {
+    _release_double_buffer(&c_effectives);
+    _release_double_buffer(&c_terminations);
+    _release_double_buffer(&c_frequencies);
+    rb_raise(rb_eArgError, "%s", err);
+  }
+
+  long num_loans = c_effectives.len;
+  if (c_terminations.len != num_loans || (!shared_frequency && c_frequencies.len != num_loans))
+    err = "effectives, terminations and frequencies must all have one entry per loan";
+
+  VALUE frequency_holder, offsets_holder, num_periods_holder, effective_holder, termination_holder, dates_holder, year_fractions_holder;
+  long *c_frequency_of = ALLOCV_N(long, frequency_holder, num_loans + 1);
+  long *offsets = ALLOCV_N(long, offsets_holder, num_loans + 1), total_periods = 0, bad_loan = -1;
+
+  for (i = 0; err == NULL && i < num_loans; i++) {
+    c_frequency_of[i] = shared_frequency ? c_frequency : (long)c_frequencies.ptr[i];
+    if (c_frequency_of[i] < 1 || c_frequency_of[i] > 12 || 12 % c_frequency_of[i] != 0) {
+      err = "frequency must be 1, 2, 3, 4, 6 or 12 payments a year";
+      bad_loan = i;
+    } else if ((long)c_terminations.ptr[i] <= (long)c_effectives.ptr[i]) {
+      err = "termination must be after effective";
+      err_class = rb_eRuntimeError;
+      bad_loan = i;
+    } else {
+      offsets[i] = total_periods;
+      total_periods += _schedule_max_periods((long)c_effectives.ptr[i], (long)c_terminations.ptr[i], c_frequency_of[i]);
+    }
+  }
+
+  if (err != NULL) {
+    _release_double_buffer(&c_effectives);
+    _release_double_buffer(&c_terminations);
+    _release_double_buffer(&c_frequencies);
+    ALLOCV_END(frequency_holder);
+    ALLOCV_END(offsets_holder);
+    if (bad_loan >= 0)
+      rb_raise(err_class, "loan %ld: %s", bad_loan, err);
+    rb_raise(err_class, "%s", err);
+  }
+
+  // the job works from GC-owned copies, so nothing needs releasing if servicing an interrupt raises
+  schedule_batch_job job = { rules,
+    _alloc_doubles(num_loans, &effective_holder),
+    _alloc_doubles(num_loans, &termination_holder),
+    c_frequency_of, num_loans,
+    offsets,
+    ALLOCV_N(long, num_periods_holder, num_loans + 1),
+    _alloc_doubles(total_periods, &dates_holder),
+    _alloc_doubles(total_periods, &year_fractions_holder) };
+  MEMCPY(job.effective, c_effectives.ptr, double, num_loans);
+  MEMCPY(job.termination, c_terminations.ptr, double, num_loans);
+  _release_double_buffer(&c_effectives);
+  _release_double_buffer(&c_terminations);
+  _release_double_buffer(&c_frequencies);
+
+  while (job.next_loan < num_loans) {
+    job.interrupted = 0;
+    rb_thread_call_without_gvl(_run_schedule_batch_job, &job, _unblock_schedule_batch_job, &job);
+  }
+
+  for (i = 0; i < num_loans; i++)
+    if (job.num_periods[i] == 0)
+      rb_raise(rb_eRuntimeError, "loan %ld: effective and termination roll onto the same business day", i);
+
+  VALUE dates_list = rb_ary_new_capa(num_loans);
+  VALUE year_fractions_list = rb_ary_new_capa(num_loans);
+  for (i = 0; i < num_loans; i++) {
+    rb_ary_push(dates_list, rb_str_new((const char *)(job.dates + offsets[i]), job.num_periods[i] * sizeof(double)));
+    rb_ary_push(year_fractions_list, rb_str_new((const char *)(job.year_fractions + offsets[i]), job.num_periods[i] * sizeof(double)));
+  }
+
+  RB_GC_GUARD(calendar);  // rules.calendar points into it
+  RB_GC_GUARD(effective_holder);
+  RB_GC_GUARD(termination_holder);
+  RB_GC_GUARD(dates_holder);
+  RB_GC_GUARD(year_fractions_holder);
+  ALLOCV_END(frequency_holder);
+  ALLOCV_END(offsets_holder);
+  ALLOCV_END(num_periods_holder);
+  return rb_assoc_new(dates_list, year_fractions_list);
+}
+
+
+void Init_schedule(VALUE mod) {
+  rb_define_module_function(mod, "schedule", schedule, -1);
+  rb_define_module_function(mod, "schedule_batch", schedule_batch, -1);
+}
\ No newline at end of file
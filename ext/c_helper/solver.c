@@ -0,0 +1,967 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "c_helper.h"
+
+/* solver.c
+ * the numerical kernels behind the exported functions; nothing in here touches the Ruby API (ruby.h isn't even
+ * included), which is what makes it safe to run them with the GVL released
+ */
+
+#define ABS(x) (((x)<0.0) ? (-(x)) : (x))
+#define SAME_SIGN(a, b) (((a) > 0.0) == ((b) > 0.0))
+
+/* on x86-64 Linux, build the hot loops for AVX-512 and AVX2 as well as the baseline, and let the loader pick */
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define CH_SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+#endif
+#ifndef CH_SIMD_CLONES
+#define CH_SIMD_CLONES
+#endif
+
+#define MAX_BRACKET_STEPS 60   // each step grows the bracket by 1.6x, so this reaches well past any sane rate
+
+
+
+
+/* _compute_pv()
+ * internal function that computes the sum of the discounted present values of a stream of cash flows, using
+ * the same logic as the Ruby code in the app
+ *
+ * assumes that the arrays are properly allocated and are num_cfs in length
+ * assumes that the discount rate and date calculations won't result in a denominator of 0
+ */
+double _compute_pv(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double spread) {
+  double discount_rate, discount_factor = 1.0, prev_cumul_date = 0.0, cumul_pv = 0.0;
+  long t;
+  
+  if (num_cfs > 0) {
+    // loop through cash flows and discount
+    for (t = 0; t < num_cfs; t++) {
+      discount_rate = libor[t] + spread;
+      discount_factor /= (1.0 + discount_rate * (dates[t] - prev_cumul_date) / year_convention);
+      cumul_pv += cfs[t] * discount_factor;
+      prev_cumul_date = dates[t];
+    }
+  
+    if (is_clean)
+      cumul_pv -= accrued_interest;
+  
+    return cumul_pv;
+  } else { // no dates or cash flows to discount
+    return CH_NO_CASH_FLOWS;
+  }
+}
+
+
+/* _compute_pv_multi()
+ * internal function that computes _compute_pv() at each of num_spreads spreads into pvs, in one sweep over the cash
+ * flows rather than one per spread: the spreads are taken SPREAD_BLOCK at a time, and each date's cash flow, libor and
+ * period are loaded once and applied to every spread in the block, with one discount factor chain per spread. The loop
+ * over the block has no dependencies between spreads, so it vectorizes, one lane per spread
+ *
+ * the arithmetic is the same as _compute_pv(), so each pvs[j] is exactly what _compute_pv() gives for spreads[j]
+ *
+ * same assumptions as _compute_pv(); pvs must have room for num_spreads values
+ */
+#define SPREAD_BLOCK 256
+
+CH_SIMD_CLONES
+void _compute_pv_multi(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double *spreads, long num_spreads, double *pvs) {
+  double discount_factors[SPREAD_BLOCK], cumul_pvs[SPREAD_BLOCK];
+  double period_days, prev_cumul_date;
+  long t, j, first, block;
+
+  if (num_cfs < 1) {  // no dates or cash flows to discount
+    for (j = 0; j < num_spreads; j++)
+      pvs[j] = CH_NO_CASH_FLOWS;
+    return;
+  }
+
+  for (first = 0; first < num_spreads; first += SPREAD_BLOCK) {
+    block = num_spreads - first < SPREAD_BLOCK ? num_spreads - first : SPREAD_BLOCK;
+    for (j = 0; j < block; j++) {
+      discount_factors[j] = 1.0;
+      cumul_pvs[j] = 0.0;
+    }
+
+    // loop through cash flows and discount, every spread in the block at once
+    prev_cumul_date = 0.0;
+    for (t = 0; t < num_cfs; t++) {
+      period_days = dates[t] - prev_cumul_date;
+      for (j = 0; j < block; j++) {
+        discount_factors[j] /= (1.0 + (libor[t] + spreads[first + j]) * period_days / year_convention);
+        cumul_pvs[j] += cfs[t] * discount_factors[j];
+      }
+      prev_cumul_date = dates[t];
+    }
+
+    for (j = 0; j < block; j++)
+      pvs[first + j] = is_clean ? cumul_pvs[j] - accrued_interest : cumul_pvs[j];
+  }
+}
+
+
+/* _compute_pv_scenarios()
+ * internal function that computes _compute_pv() for num_scenarios shifted copies of one loan's libor, in one sweep
+ * over the cash flows: scenario j discounts at libor[t] + shifts[t * num_scenarios + j] + spreads[j]. As in
+ * _compute_pv_multi(), the scenarios are taken SPREAD_BLOCK at a time and the loop over a block vectorizes, one lane
+ * per scenario; the shifts are laid out scenario-fastest so that each date's shifts are contiguous
+ *
+ * the arithmetic is the same as _compute_pv() on libor already shifted, so pvs[j] is exactly what _compute_pv() gives
+ * for scenario j
+ *
+ * same assumptions as _compute_pv(); shifts must hold num_cfs * num_scenarios values, pvs room for num_scenarios
+ */
+CH_SIMD_CLONES
+void _compute_pv_scenarios(double *cfs, double *dates, double *libor, double *shifts, long num_cfs, long num_scenarios, char is_clean, double accrued_interest, double year_convention, double *spreads, double *pvs) {
+  double discount_factors[SPREAD_BLOCK], cumul_pvs[SPREAD_BLOCK];
+  double period_days, prev_cumul_date, *shifts_t;
+  long t, j, first, block;
+
+  if (num_cfs < 1) {  // no dates or cash flows to discount
+    for (j = 0; j < num_scenarios; j++)
+      pvs[j] = CH_NO_CASH_FLOWS;
+    return;
+  }
+
+  for (first = 0; first < num_scenarios; first += SPREAD_BLOCK) {
+    block = num_scenarios - first < SPREAD_BLOCK ? num_scenarios - first : SPREAD_BLOCK;
+    for (j = 0; j < block; j++) {
+      discount_factors[j] = 1.0;
+      cumul_pvs[j] = 0.0;
+    }
+
+    // loop through cash flows and discount, every scenario in the block at once
+    prev_cumul_date = 0.0;
+    for (t = 0; t < num_cfs; t++) {
+      period_days = dates[t] - prev_cumul_date;
+      shifts_t = shifts + t * num_scenarios + first;
+      for (j = 0; j < block; j++) {
+        discount_factors[j] /= (1.0 + ((libor[t] + shifts_t[j]) + spreads[first + j]) * period_days / year_convention);
+        cumul_pvs[j] += cfs[t] * discount_factors[j];
+      }
+      prev_cumul_date = dates[t];
+    }
+
+    for (j = 0; j < block; j++)
+      pvs[first + j] = is_clean ? cumul_pvs[j] - accrued_interest : cumul_pvs[j];
+  }
+}
+
+
+/* _compute_pv_paths()
+ * internal function that computes the dirty _compute_pv() at spread over each of num_paths libor paths, in one sweep
+ * over the cash flows: path j's libor for cash flow t is paths[t * stride + j], so a slice of a scenario-fastest
+ * matrix can be handed over by pointing paths at its first column. As in _compute_pv_multi(), the paths are taken
+ * SPREAD_BLOCK at a time and the loop over a block vectorizes, one lane per path
+ *
+ * unless dpvs is NULL, each path's derivative with respect to the spread goes into it, as _compute_pv_and_deriv()
+ * works it out; either way the arithmetic is the same as the scalar kernels', so pvs[j] is exactly what they give
+ *
+ * same assumptions as _compute_pv(); pvs (and dpvs) must have room for num_paths values
+ */
+CH_SIMD_CLONES
+void _compute_pv_paths(double *cfs, double *dates, double *paths, long stride, long num_cfs, long num_paths, double year_convention, double spread, double *pvs, double *dpvs) {
+  double discount_factors[SPREAD_BLOCK], cumul_pvs[SPREAD_BLOCK], cumul_durations[SPREAD_BLOCK], cumul_dpvs[SPREAD_BLOCK];
+  double period_days, period, denominator, prev_cumul_date, *rates;
+  long t, j, first, block;
+
+  for (first = 0; first < num_paths; first += SPREAD_BLOCK) {
+    block = num_paths - first < SPREAD_BLOCK ? num_paths - first : SPREAD_BLOCK;
+    for (j = 0; j < block; j++) {
+      discount_factors[j] = 1.0;
+      cumul_pvs[j] = cumul_durations[j] = cumul_dpvs[j] = 0.0;
+    }
+
+    // loop through cash flows and discount, every path in the block at once
+    prev_cumul_date = 0.0;
+    for (t = 0; t < num_cfs; t++) {
+      period_days = dates[t] - prev_cumul_date;
+      rates = paths + t * stride + first;
+      if (dpvs == NULL) {
+        for (j = 0; j < block; j++) {
+          discount_factors[j] /= (1.0 + (rates[j] + spread) * period_days / year_convention);
+          cumul_pvs[j] += cfs[t] * discount_factors[j];
+        }
+      } else {
+        period = period_days / year_convention;
+        for (j = 0; j < block; j++) {
+          denominator = 1.0 + (rates[j] + spread) * period_days / year_convention;
+          discount_factors[j] /= denominator;
+          cumul_durations[j] += period / denominator;
+          cumul_pvs[j] += cfs[t] * discount_factors[j];
+          cumul_dpvs[j] -= cfs[t] * discount_factors[j] * cumul_durations[j];
+        }
+      }
+      prev_cumul_date = dates[t];
+    }
+
+    for (j = 0; j < block; j++) {
+      pvs[first + j] = num_cfs > 0 ? cumul_pvs[j] : CH_NO_CASH_FLOWS;
+      if (dpvs != NULL)
+        dpvs[first + j] = cumul_dpvs[j];
+    }
+  }
+}
+
+
+/* _fast_exp()
+ * e^x for the IRR kernels, written as plain arithmetic (no libm call) so that the compiler can vectorize loops over it:
+ * x = n ln2 + r with |r| <= ln2 / 2, e^r from its Taylor series to r^13 (good to about 1 ulp on that range), and 2^n
+ * built straight into the exponent bits
+ *
+ * x is clamped to [-708, 709], where e^x is a normal double; NaN goes through as NaN
+ */
+static inline double _fast_exp(double x) {
+  double n, r, p, scale;
+  int64_t bits;
+
+  x = x < -708.0 ? -708.0 : (x > 709.0 ? 709.0 : x);
+
+  // adding 1.5 * 2^52 rounds x / ln2 to the nearest integer and leaves that integer in the low bits of the mantissa
+  n = x * 1.4426950408889634 + 6755399441055744.0;
+  memcpy(&bits, &n, sizeof(bits));
+  n -= 6755399441055744.0;
+
+  // ln2 split in two (Cody-Waite) so that n * ln2 is exact enough not to swamp r
+  r = x - n * 6.93147180369123816490e-01 - n * 1.90821492927058770002e-10;
+  p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040 +
+      r * (1.0 / 40320 + r * (1.0 / 362880 + r * (1.0 / 3628800 + r * (1.0 / 39916800 + r * (1.0 / 479001600 +
+      r * (1.0 / 6227020800.0)))))))))))));
+
+  bits = (bits + 1023) << 52;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+
+/* _discount_for_irr()
+ * internal function that is the loop behind all the IRR PVs: sum of cfs[t] / (1 + irr)^yf_t with
+ * yf_t = (times[t] - origin) / year_convention, plus, when dpv_dirr isn't NULL, the derivative of that sum with respect
+ * to the IRR, d/dirr (1 + irr)^-yf = -yf / (1 + irr) * (1 + irr)^-yf
+ *
+ * (1 + irr)^-yf is computed as exp(-yf * log1p(irr)), so the log is taken once per call instead of a pow() per cash
+ * flow, and the sums are spread over IRR_LANES independent accumulators so the loop vectorizes; on x86-64 Linux it is
+ * also compiled for AVX2 and AVX-512 and the best version for the CPU is picked at load time
+ */
+#define IRR_LANES 8
+
+CH_SIMD_CLONES
+static double _discount_for_irr(double *cfs, double *times, long num_cfs, double origin, double year_convention, double irr, double *dpv_dirr) {
+  double log_discount = -log1p(irr), year_fraction, discount_factor, cumul_pv = 0.0, cumul_dpv = 0.0;
+  double pv_lanes[IRR_LANES] = { 0.0 }, dpv_lanes[IRR_LANES] = { 0.0 };
+  long t, j;
+
+  if (dpv_dirr == NULL) {
+    for (t = 0; t + IRR_LANES <= num_cfs; t += IRR_LANES)
+      for (j = 0; j < IRR_LANES; j++)
+        pv_lanes[j] += cfs[t + j] * _fast_exp(log_discount * ((times[t + j] - origin) / year_convention));
+    for (; t < num_cfs; t++)
+      cumul_pv += cfs[t] * _fast_exp(log_discount * ((times[t] - origin) / year_convention));
+  } else {
+    for (t = 0; t + IRR_LANES <= num_cfs; t += IRR_LANES) {
+      for (j = 0; j < IRR_LANES; j++) {
+        year_fraction = (times[t + j] - origin) / year_convention;
+        discount_factor = _fast_exp(log_discount * year_fraction);
+        pv_lanes[j]  += cfs[t + j] * discount_factor;
+        dpv_lanes[j] -= cfs[t + j] * discount_factor * year_fraction;
+      }
+    }
+    for (; t < num_cfs; t++) {
+      year_fraction = (times[t] - origin) / year_convention;
+      discount_factor = _fast_exp(log_discount * year_fraction);
+      cumul_pv  += cfs[t] * discount_factor;
+      cumul_dpv -= cfs[t] * discount_factor * year_fraction;
+    }
+  }
+
+  for (j = 0; j < IRR_LANES; j++) {
+    cumul_pv  += pv_lanes[j];
+    cumul_dpv += dpv_lanes[j];
+  }
+
+  if (dpv_dirr != NULL)
+    *dpv_dirr = cumul_dpv / (1.0 + irr);
+  return cumul_pv;
+}
+
+
+/* _compute_pv_for_irr()
+ * internal function that computes the sum of the discounted present values of a stream of cash flows, using
+ * the same logic as the Ruby code in the app
+ * 
+ * Logic is annual compounded discount rates over day_count year fractions from the first date (Actual/365 for
+ * CH_ACT_365F, as it always was)
+ *
+ * assumes that the arrays are properly allocated and are num_cfs in length
+ * assumes that the discount rate and date calculations won't result in a denominator of 0
+ */
+double _compute_pv_for_irr(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, int day_count, double irr) {
+  double cumul_pv = 0.0, year_fractions[256];
+  long t, chunk;
+  
+  if (num_cfs > 0) {
+    // loop through cash flows and discount; the Actual conventions discount the dates as they are, the others a chunk
+    // of year fractions at a time
+    if (day_count == CH_ACT_365F || day_count == CH_ACT_360)
+      cumul_pv = _discount_for_irr(cfs, dates, num_cfs, dates[0], day_count == CH_ACT_360 ? 360.0 : 365.0, irr, NULL);
+    else
+      for (t = 0; t < num_cfs; t += chunk) {
+        chunk = num_cfs - t < 256 ? num_cfs - t : 256;
+        _year_fractions(dates + t, chunk, dates[0], day_count, year_fractions);
+        cumul_pv += _discount_for_irr(cfs + t, year_fractions, chunk, 0.0, 1.0, irr, NULL);
+      }
+  
+    if (is_clean)
+      cumul_pv -= accrued_interest;
+
+    return cumul_pv;
+  } else { // no dates to discount
+    return CH_NO_CASH_FLOWS;
+  }  
+}
+
+
+/* _irr_year_fractions()
+ * internal function that turns the dates of an IRR stream into the day_count year fractions _compute_pv_for_irr()
+ * discounts over, so that a solve can work them out once rather than on every iteration
+ */
+void _irr_year_fractions(double *dates, long num_cfs, int day_count, double *year_fractions) {
+  _year_fractions(dates, num_cfs, dates[0], day_count, year_fractions);
+}
+
+
+/* _compute_pv_for_irr_yf()
+ * internal function that computes the same PV as _compute_pv_for_irr(), from year fractions already worked out by
+ * _irr_year_fractions(); also gives dPV/dIRR when dpv_dirr isn't NULL
+ */
+double _compute_pv_for_irr_yf(double *cfs, double *year_fractions, long num_cfs, char is_clean, double accrued_interest, double irr, double *dpv_dirr) {
+  double cumul_pv;
+
+  if (num_cfs > 0) {
+    cumul_pv = _discount_for_irr(cfs, year_fractions, num_cfs, 0.0, 1.0, irr, dpv_dirr);
+
+    if (is_clean)
+      cumul_pv -= accrued_interest;
+
+    return cumul_pv;
+  } else { // no dates to discount
+    if (dpv_dirr != NULL)
+      *dpv_dirr = 0.0;
+    return CH_NO_CASH_FLOWS;
+  }
+}
+
+
+/* _compute_pv_and_deriv()
+ * internal function that computes the same PV as _compute_pv(), and in the same pass the derivative of that PV with
+ * respect to the spread, for the Newton solver
+ *
+ * each discount factor is a product of 1 / (1 + r_k * tau_k) terms, so its derivative with respect to the spread is
+ * -DF_t * sum_{k<=t} tau_k / (1 + r_k * tau_k); the running sum is carried along with the discount factor
+ *
+ * same assumptions as _compute_pv()
+ */
+double _compute_pv_and_deriv(double *cfs, double *dates, double *libor, long num_cfs, char is_clean, double accrued_interest, double year_convention, double spread, double *dpv_dspread) {
+  double discount_rate, period, denominator, discount_factor = 1.0, prev_cumul_date = 0.0, cumul_pv = 0.0;
+  double cumul_duration = 0.0, cumul_dpv = 0.0;
+  long t;
+  
+  if (num_cfs > 0) {
+    // loop through cash flows and discount
+    for (t = 0; t < num_cfs; t++) {
+      discount_rate = libor[t] + spread;
+      period = (dates[t] - prev_cumul_date) / year_convention;
+      denominator = 1.0 + discount_rate * (dates[t] - prev_cumul_date) / year_convention;
+      discount_factor /= denominator;
+      cumul_duration += period / denominator;
+      cumul_pv += cfs[t] * discount_factor;
+      cumul_dpv -= cfs[t] * discount_factor * cumul_duration;
+      prev_cumul_date = dates[t];
+    }
+  
+    if (is_clean)
+      cumul_pv -= accrued_interest;
+  
+    *dpv_dspread = cumul_dpv;
+    return cumul_pv;
+  } else { // no dates or cash flows to discount
+    *dpv_dspread = 0.0;
+    return CH_NO_CASH_FLOWS;
+  }
+}
+
+
+/* _compute_pv_risk()
+ * internal function for the risk pass once a spread has been solved for: in one sweep over the cash flows, the PV at
+ * spread (dirty, so is_clean doesn't come into it) into risk[0], and its first and second derivatives with respect to
+ * the spread into risk[1] and risk[2]. As the discount rate is libor + spread, these are also the derivatives with
+ * respect to a parallel shift in the yield
+ *
+ * as in _compute_pv_and_deriv(), dDF_t/ds = -DF_t * A_t with A_t = sum_{k<=t} tau_k / (1 + r_k * tau_k); differentiating
+ * again gives d2DF_t/ds2 = DF_t * (A_t^2 + B_t), with B_t the running sum of the squares of the same terms
+ *
+ * same assumptions as _compute_pv()
+ */
+void _compute_pv_risk(double *cfs, double *dates, double *libor, long num_cfs, double year_convention, double spread, double *risk) {
+  double period, denominator, discount_factor = 1.0, prev_cumul_date = 0.0;
+  double a = 0.0, b = 0.0, cumul_pv = 0.0, cumul_dpv = 0.0, cumul_d2pv = 0.0;
+  long t;
+
+  for (t = 0; t < num_cfs; t++) {
+    period = (dates[t] - prev_cumul_date) / year_convention;
+    denominator = 1.0 + (libor[t] + spread) * period;
+    discount_factor /= denominator;
+    a += period / denominator;
+    b += (period / denominator) * (period / denominator);
+    cumul_pv   += cfs[t] * discount_factor;
+    cumul_dpv  -= cfs[t] * discount_factor * a;
+    cumul_d2pv += cfs[t] * discount_factor * (a * a + b);
+    prev_cumul_date = dates[t];
+  }
+
+  risk[0] = cumul_pv;
+  risk[1] = cumul_dpv;
+  risk[2] = cumul_d2pv;
+}
+
+
+/* _compute_pv_for_irr_risk()
+ * internal function that is to an IRR what _compute_pv_risk() is to a spread: the PV at irr, dPV/dIRR and d2PV/dIRR2
+ * into risk[0..2], discounting as _compute_pv_for_irr() does
+ *
+ * the cash flows on the first date are the purchase, not part of what's being priced, so they're left out of the PV
+ * (they don't move with the IRR, so they never contribute to the derivatives)
+ */
+void _compute_pv_for_irr_risk(double *cfs, double *dates, long num_cfs, int day_count, double irr, double *risk) {
+  double year_fraction, discount_factor, cumul_pv = 0.0, cumul_dpv = 0.0, cumul_d2pv = 0.0;
+  long t;
+
+  for (t = 0; t < num_cfs; t++) {
+    year_fraction = _year_fraction(dates[0], dates[t], day_count);
+    if (year_fraction <= 0.0)
+      continue;
+    discount_factor = pow(1.0 + irr, -year_fraction);
+    cumul_pv   += cfs[t] * discount_factor;
+    cumul_dpv  -= cfs[t] * discount_factor * year_fraction / (1.0 + irr);
+    cumul_d2pv += cfs[t] * discount_factor * year_fraction * (year_fraction + 1.0) / ((1.0 + irr) * (1.0 + irr));
+  }
+
+  risk[0] = cumul_pv;
+  risk[1] = cumul_dpv;
+  risk[2] = cumul_d2pv;
+}
+
+
+/* _bracket_and_brent()
+ * internal function behind CH_BRENT: starting from the two secant seeds, widen [a, b] until f changes sign across it,
+ * then close in on the root with Brent's method (inverse quadratic interpolation or a secant step when that lands
+ * well inside the bracket, bisection when it doesn't), so every step keeps the root bracketed and the solve can't
+ * overshoot into divergence the way the open methods can
+ *
+ * x_min is where f stops being defined (e.g. an IRR of -100%); the bracket is never widened past it
+ *
+ * returns CH_NO_BRACKET if no sign change turns up within MAX_BRACKET_STEPS widenings, i.e. there's no root (or none
+ * within reach); otherwise converges once |f| <= res, or once the bracket has shrunk to the precision of a double
+ */
+static double _bracket_and_brent(objective_fn f, void *data, double x_min, solver_opts *opts, double a, double b, double fa, double fb) {
+  double c, fc, d, e, m, p, q, r, s, tol, prev;
+  long steps, trials = 0;
+
+  for (steps = 0; fa != 0.0 && fb != 0.0 && SAME_SIGN(fa, fb) && steps < MAX_BRACKET_STEPS; steps++, opts->iterations++) {
+    if (opts->interrupted != NULL && *opts->interrupted)
+      return CH_INTERRUPTED;
+
+    // widen on the side where f is closer to 0
+    if (ABS(fa) < ABS(fb)) {
+      prev = a;
+      a += 1.6 * (a - b);
+      if (a <= x_min)
+        a = x_min + 0.5 * (prev - x_min);
+      fa = f(data, a, NULL);
+    } else {
+      b += 1.6 * (b - a);
+      fb = f(data, b, NULL);
+    }
+  }
+
+  // SAME_SIGN() counts 0.0 as negative, so an end point that is already the root has to be caught before it's tested
+  if (fa == 0.0 || fb == 0.0) {
+    opts->residual = 0.0;
+    return fb == 0.0 ? b : a;
+  }
+  if (SAME_SIGN(fa, fb) || isnan(fa) || isnan(fb)) {
+    opts->residual = ABS(fa) < ABS(fb) ? fa : fb;
+    return CH_NO_BRACKET;
+  }
+
+  // Brent's method, as in Numerical Recipes' zbrent(); b is the best estimate so far and [b, c] brackets the root
+  c = b; fc = fb;
+  d = e = b - a;
+
+  while (trials < opts->max_tries) {
+    if (opts->interrupted != NULL && *opts->interrupted)
+      return CH_INTERRUPTED;
+
+    if (SAME_SIGN(fb, fc)) {
+      c = a; fc = fa;
+      d = e = b - a;
+    }
+    if (ABS(fc) < ABS(fb)) {
+      a = b; b = c; c = a;
+      fa = fb; fb = fc; fc = fa;
+    }
+
+    opts->residual = fb;
+    tol = 2.0 * DBL_EPSILON * ABS(b);
+    m = 0.5 * (c - b);
+    if (ABS(fb) <= opts->res || ABS(m) <= tol)
+      return b;
+
+    if (ABS(e) >= tol && ABS(fa) > ABS(fb)) {
+      s = fb / fa;
+      if (a == c) {  // secant
+        p = 2.0 * m * s;
+        q = 1.0 - s;
+      } else {       // inverse quadratic interpolation
+        q = fa / fc;
+        r = fb / fc;
+        p = s * (2.0 * m * q * (q - r) - (b - a) * (r - 1.0));
+        q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+      }
+      if (p > 0.0) q = -q; else p = -p;
+
+      if (2.0 * p < fmin(3.0 * m * q - ABS(tol * q), ABS(e * q))) {
+        e = d;
+        d = p / q;
+      } else {  // interpolation would step outside the bracket or isn't shrinking it fast enough: bisect
+        d = m;
+        e = d;
+      }
+    } else {
+      d = m;
+      e = d;
+    }
+
+    a = b; fa = fb;
+    b += ABS(d) > tol ? d : (m > 0.0 ? tol : -tol);
+    fb = f(data, b, NULL);
+
+    trials++;
+    opts->iterations++;
+  }
+
+  opts->residual = fb;
+  return CH_FAILED_TO_CONVERGE;
+}
+
+
+/* _solve()
+ * internal function that finds the root of f, the one root-finding loop shared by the price backsolve and the IRR;
+ * f(x) is the target NPV less the NPV at x, and f also gives f'(x) when asked for it (deriv not NULL)
+ *
+ * opts->method picks the iteration:
+ *  - CH_SECANT: the original algorithm, a secant method seeded at 6% and 6.25%; one f evaluation per iteration
+ *  - CH_NEWTON: Newton-Raphson from 6% using the analytic derivative; one fused evaluation (value and derivative
+ *    together) per iteration, and it converges in fewer of them
+ *  - CH_BRENT: brackets the root first and then uses Brent's method; see _bracket_and_brent()
+ *
+ * x_min is where f stops being defined (e.g. an IRR of -100%): a secant step that would land on or below it goes
+ * halfway from the current x to x_min instead, and a Newton step is halved back towards the current x until it's above
+ * x_min. A NaN or infinite f' fails the solve just as such an f does
+ *
+ * all start from opts->guess, falling back to 6% if the guess isn't above x_min, and return it straight away if it's
+ * already within opts->res. The secant methods' second point is 25bp above 6%, but only 1bp above any other guess: a
+ * guess is usually yesterday's answer, a few bp from the root, and a 25bp step would throw most of that away
+ *
+ * opts->iterations is set to the number of iterations taken (for CH_BRENT, bracket widenings count as iterations too),
+ * and opts->residual to f at the final x, whether or not the solve converged
+ *
+ * all stop once |f| <= opts->res, and give up with CH_FAILED_TO_CONVERGE after opts->max_tries iterations or as soon as
+ * f comes out NaN or infinite (which would otherwise pass for convergence, as NaN > res is false), or with
+ * CH_NO_SENSITIVITY if the step can't be computed (f doesn't change between secant points, or f' is 0)
+ *
+ * opts->interrupted may be NULL; otherwise it's polled once per iteration and the solve gives up with CH_INTERRUPTED as
+ * soon as it's set (it's set by the unblocking function when we run without the GVL)
+ */
+double _solve(objective_fn f, void *data, double x_min, solver_opts *opts) {
+  double x_n_minus_1 = opts->guess > x_min ? opts->guess : 0.06; // starting point of 6%, unless we've been given one
+  double x_n = x_n_minus_1 + (x_n_minus_1 == 0.06 ? 0.0025 : 0.0001);
+  double x_n_plus_1;
+  double f_n_minus_1, f_n, df_n = 0.0;
+
+  opts->iterations = 0;
+  
+  if (opts->method == CH_NEWTON) {
+    x_n = x_n_minus_1;
+    f_n_minus_1 = f_n = f(data, x_n, &df_n);
+  } else {
+    f_n_minus_1 = f(data, x_n_minus_1, NULL);
+    if (ABS(f_n_minus_1) <= opts->res) {
+      opts->residual = f_n_minus_1;
+      return x_n_minus_1;
+    }
+    f_n         = f(data, x_n,         NULL);
+  }
+  opts->residual = f_n;
+  
+  if (opts->method == CH_BRENT)
+    return _bracket_and_brent(f, data, x_min, opts, x_n_minus_1, x_n, f_n_minus_1, f_n);
+  
+  long trials = 0;
+  
+  if (!isfinite(f_n_minus_1) || !isfinite(f_n))
+    return CH_FAILED_TO_CONVERGE;
+
+  while (ABS(f_n) > opts->res && trials < opts->max_tries) {
+    if (opts->interrupted != NULL && *opts->interrupted)
+      return CH_INTERRUPTED;
+
+    if (opts->method == CH_NEWTON) {
+      if (df_n == 0.0) {
+        return CH_NO_SENSITIVITY;
+        // ERROR! Can't divide by 0
+      }
+      x_n_plus_1    = x_n - f_n / df_n;
+      if (!isfinite(df_n) || !isfinite(x_n_plus_1))
+        return CH_FAILED_TO_CONVERGE;
+      while (x_n_plus_1 <= x_min)  // halve the step back towards x_n until it's somewhere f is defined
+        x_n_plus_1  = x_n + 0.5 * (x_n_plus_1 - x_n);
+      x_n           = x_n_plus_1;
+      f_n           = f(data, x_n, &df_n);
+      opts->residual = f_n;
+    } else {
+      if (f_n == f_n_minus_1) {
+        return CH_NO_SENSITIVITY;
+        // ERROR! Can't divide by 0
+      }
+      x_n_plus_1    = x_n - f_n * (x_n - x_n_minus_1) / (f_n - f_n_minus_1);
+      if (x_n_plus_1 <= x_min)
+        x_n_plus_1  = x_min + 0.5 * (x_n - x_min);
+      x_n_minus_1   = x_n;
+      x_n           = x_n_plus_1;
+
+      f_n_minus_1   = f_n;   // previous result
+      f_n           = f(data, x_n, NULL);
+      opts->residual = f_n;
+    }
+    
+    trials++;
+    opts->iterations = trials;
+
+    if (!isfinite(f_n))
+      return CH_FAILED_TO_CONVERGE;
+  }
+  
+  if (trials >= opts->max_tries)
+    return CH_FAILED_TO_CONVERGE;
+  
+  return x_n;
+}
+
+
+typedef struct {
+  double *cfs, *dates, *libor;
+  long num_cfs;
+  double target_px;
+  char is_clean;
+  double accrued_interest, year_convention;
+} pv_objective;
+
+static double _pv_objective(void *data, double spread, double *deriv) {
+  pv_objective *o = (pv_objective *)data;
+  double dpv;
+
+  if (deriv == NULL)
+    return o->target_px - _compute_pv(o->cfs, o->dates, o->libor, o->num_cfs, o->is_clean, o->accrued_interest, o->year_convention, spread);
+
+  double pv = _compute_pv_and_deriv(o->cfs, o->dates, o->libor, o->num_cfs, o->is_clean, o->accrued_interest, o->year_convention, spread, &dpv);
+  *deriv = -dpv;
+  return o->target_px - pv;
+}
+
+// for IRRs, dates holds the year fractions from _irr_year_fractions() rather than the dates themselves
+static double _irr_objective(void *data, double irr, double *deriv) {
+  pv_objective *o = (pv_objective *)data;
+  double dpv;
+
+  double pv = _compute_pv_for_irr_yf(o->cfs, o->dates, o->num_cfs, o->is_clean, o->accrued_interest, irr, deriv == NULL ? NULL : &dpv);
+  if (deriv != NULL)
+    *deriv = -dpv;
+  return o->target_px - pv;
+}
+
+
+/* _backsolve_cf()
+ * internal function that uses _solve() to find, for a given set of cash flows and a target NPV, what discount *spread*
+ * (i.e. spread over libor) will get to that NPV.
+ *
+ * note that the NPV isn't a price (% of par), but rather a total dollar amount
+ *
+ * if you have a fixed-rate loan, just pass a string of 0's in the libor array and it will return a yield instead of a spread
+ *
+ * assumes that arrays are allocated and num_cfs in length
+ * assumes that -999.0 and -998.0 will never be valid return values for spreads
+ */
+double _backsolve_cf(double *cfs, double *dates, double *libor, long num_cfs, double target_px, char is_clean, double accrued_interest, double year_convention, solver_opts *opts) {
+  pv_objective o = { cfs, dates, libor, num_cfs, target_px, is_clean, accrued_interest, year_convention };
+  double x_min = -HUGE_VAL, prev_cumul_date = 0.0;
+  long t;
+
+  // below this spread some 1 + r * tau denominator in _compute_pv() goes through 0
+  if (opts->method == CH_BRENT) {
+    for (t = 0; t < num_cfs; t++) {
+      if (dates[t] > prev_cumul_date)
+        x_min = fmax(x_min, -libor[t] - year_convention / (dates[t] - prev_cumul_date));
+      prev_cumul_date = dates[t];
+    }
+  }
+
+  return _solve(_pv_objective, &o, x_min, opts);
+}
+
+
+/* _backsolve_irr()
+ * internal function that uses _solve() to find, for a given set of cash flows, what IRR will get to an NPV of 0.0.
+ *
+ * note that the NPV isn't a price (% of par), but rather a total dollar amount
+ *
+ * assumes that arrays are allocated and num_cfs in length
+ * assumes that -999.0 and -998.0 will never be valid return values for spreads
+ */
+double _backsolve_irr(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, solver_opts *opts) {
+  double stack_year_fractions[256], *year_fractions = stack_year_fractions, result;
+
+  // the year fractions are the same on every iteration, so work them out once up front
+  if (num_cfs > 256) {
+    year_fractions = malloc(num_cfs * sizeof(double));
+    if (year_fractions == NULL) {
+      opts->iterations = 0;
+      opts->residual = NAN;
+      return CH_NO_MEMORY;
+    }
+  }
+  _irr_year_fractions(dates, num_cfs, opts->day_count, year_fractions);
+
+  pv_objective o = { cfs, year_fractions, NULL, num_cfs, 0.0, is_clean, accrued_interest, 0.0 };
+  result = _solve(_irr_objective, &o, -1.0, opts);  // (1 + irr)^yf isn't real below an IRR of -100%
+
+  if (year_fractions != stack_year_fractions)
+    free(year_fractions);
+  return result;
+}
+
+
+/* _count_solve()
+ * internal function that tallies a finished _backsolve_cf() or _backsolve_irr() into stats; it runs once per solve, so
+ * it stays out of the iteration loop
+ */
+void _count_solve(solver_stats *stats, double result, solver_opts *opts) {
+  long bucket = opts->iterations < CH_ITERATION_BUCKETS - 1 ? opts->iterations : CH_ITERATION_BUCKETS - 1;
+
+  stats->solves++;
+  stats->iterations[bucket]++;
+  if (opts->iterations > stats->max_iterations)
+    stats->max_iterations = opts->iterations;
+
+  // the iterations make one evaluation each, after the seeds: one for Newton, two (the secant points) otherwise, or just
+  // the one when _solve() found the guess already within res
+  if (result != CH_NO_MEMORY)
+    stats->pv_evaluations += opts->iterations + (opts->method == CH_NEWTON || result == opts->guess ? 1 : 2);
+
+  if (result == CH_FAILED_TO_CONVERGE)
+    stats->failed_to_converge++;
+  else if (result == CH_NO_SENSITIVITY)
+    stats->no_sensitivity++;
+  else if (result == CH_NO_BRACKET || result == CH_NO_MEMORY)
+    stats->other_failures++;
+}
+
+
+/* _irr_sign_changes()
+ * internal function that counts the sign changes in an IRR stream, which by Descartes' rule of signs bounds how many
+ * IRRs above -100% it can have: the NPV is a generalized polynomial in 1 / (1 + irr), with one term per date. Cash
+ * flows on the same date are netted first (a clean PV's -accrued_interest counts as one more on the first date), so
+ * that they can't inflate the count, and zero terms are skipped
+ */
+long _irr_sign_changes(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest) {
+  double term, prev_term = 0.0;
+  long t, changes = 0;
+
+  for (t = 0; t < num_cfs; ) {
+    term = t == 0 && is_clean ? -accrued_interest : 0.0;
+    do {
+      term += cfs[t++];
+    } while (t < num_cfs && dates[t] == dates[t - 1]);
+
+    if (term != 0.0) {
+      if (prev_term != 0.0 && !SAME_SIGN(term, prev_term))
+        changes++;
+      prev_term = term;
+    }
+  }
+
+  return changes;
+}
+
+
+/* _irr_roots()
+ * internal function that finds every IRR of a stream between lower and upper (both > -100%), in ascending order, into
+ * roots (room for num_cfs); returns how many it found, or a sentinel
+ *
+ * the bound from _irr_sign_changes() comes first: with no sign change there's no IRR to look for. Otherwise the NPV
+ * is scanned at steps + 1 points spaced evenly in log(1 + irr) (evenly in the discount exponent, which spreads them
+ * where the NPV curves most), each sign change between neighbours is closed in on with Brent's method, and the scan
+ * stops early once it has found as many roots as Descartes allows. A root where the NPV only touches 0 without
+ * crossing, or two roots closer together than the grid, can slip between points; a finer grid finds them
+ *
+ * opts->iterations counts the scan's NPV evaluations as well as the iterations taken on each root, so it's every
+ * evaluation made; opts->residual is the NPV at the last root
+ */
+double _irr_roots(double *cfs, double *dates, long num_cfs, char is_clean, double accrued_interest, double lower, double upper, long steps, solver_opts *opts, double *roots) {
+  double stack_year_fractions[256], *year_fractions = stack_year_fractions;
+  double x_lower = log1p(lower), x_upper = log1p(upper), a, b, fa, fb, root;
+  long k, max_roots, num_roots = 0;
+
+  opts->iterations = 0;
+  opts->residual = NAN;
+  if (num_cfs < 1)
+    return CH_NO_CASH_FLOWS;
+  if ((max_roots = _irr_sign_changes(cfs, dates, num_cfs, is_clean, accrued_interest)) == 0)
+    return 0.0;
+
+  if (num_cfs > 256) {
+    year_fractions = malloc(num_cfs * sizeof(double));
+    if (year_fractions == NULL)
+      return CH_NO_MEMORY;
+  }
+  _irr_year_fractions(dates, num_cfs, opts->day_count, year_fractions);
+  pv_objective o = { cfs, year_fractions, NULL, num_cfs, 0.0, is_clean, accrued_interest, 0.0 };
+
+  b = lower;
+  fb = _irr_objective(&o, b, NULL);
+  opts->iterations++;
+  for (k = 1; k <= steps && num_roots < max_roots; k++) {
+    if (opts->interrupted != NULL && *opts->interrupted) {
+      num_roots = (long)CH_INTERRUPTED;
+      break;
+    }
+
+    a = b; fa = fb;
+    b = k == steps ? upper : expm1(x_lower + (x_upper - x_lower) * k / steps);
+    fb = _irr_objective(&o, b, NULL);
+    opts->iterations++;
+
+    if (fa == 0.0) {
+      roots[num_roots++] = a;
+      opts->residual = 0.0;
+    } else if (fb != 0.0 && !SAME_SIGN(fa, fb)) {
+      root = _bracket_and_brent(_irr_objective, &o, -1.0, opts, a, b, fa, fb);
+      if (root == CH_INTERRUPTED || root == CH_FAILED_TO_CONVERGE) {
+        num_roots = (long)root;
+        break;
+      }
+      roots[num_roots++] = root;
+    }
+  }
+  if (num_roots >= 0 && num_roots < max_roots && fb == 0.0 && k > steps) {
+    roots[num_roots++] = b;
+    opts->residual = 0.0;
+  }
+
+  if (year_fractions != stack_year_fractions)
+    free(year_fractions);
+  return (double)num_roots;
+}
+
+
+/* _backsolve_cf_scenarios()
+ * internal function that backsolves the spread for every scenario of _compute_pv_scenarios() at once: each scenario
+ * runs the CH_SECANT iteration of _solve(), step for step, but all in lockstep, so each round is one vectorized sweep
+ * over the cash flows for every scenario rather than one sweep per scenario. A scenario that has finished keeps its
+ * spread and just rides along
+ *
+ * results[j] gets scenario j's spread or sentinel, exactly as _backsolve_cf() would give on libor shifted by hand;
+ * returns 0.0, or CH_NO_MEMORY or CH_INTERRUPTED if the whole solve was abandoned
+ */
+double _backsolve_cf_scenarios(double *cfs, double *dates, double *libor, double *shifts, long num_cfs, long num_scenarios, double target_px, char is_clean, double accrued_interest, double year_convention, solver_opts *opts, double *results) {
+  double *x_n_minus_1, *x_n, *f_n_minus_1, *f_n, *pvs, x_n_plus_1;
+  long *trials, j, active = num_scenarios;
+
+  x_n_minus_1 = malloc(5 * num_scenarios * sizeof(double) + 1);
+  trials      = calloc(num_scenarios + 1, sizeof(long));  // -1 once a scenario is done
+  if (x_n_minus_1 == NULL || trials == NULL) {
+    free(x_n_minus_1); free(trials);
+    return CH_NO_MEMORY;
+  }
+  x_n         = x_n_minus_1 + num_scenarios;
+  f_n_minus_1 = x_n_minus_1 + 2 * num_scenarios;
+  f_n         = x_n_minus_1 + 3 * num_scenarios;
+  pvs         = x_n_minus_1 + 4 * num_scenarios;
+
+  for (j = 0; j < num_scenarios; j++) {
+    x_n_minus_1[j] = opts->guess > -HUGE_VAL ? opts->guess : 0.06;  // as _solve() seeds, with no x_min
+    x_n[j] = x_n_minus_1[j] + (x_n_minus_1[j] == 0.06 ? 0.0025 : 0.0001);
+  }
+  _compute_pv_scenarios(cfs, dates, libor, shifts, num_cfs, num_scenarios, is_clean, accrued_interest, year_convention, x_n_minus_1, pvs);
+  for (j = 0; j < num_scenarios; j++)
+    f_n_minus_1[j] = target_px - pvs[j];
+  _compute_pv_scenarios(cfs, dates, libor, shifts, num_cfs, num_scenarios, is_clean, accrued_interest, year_convention, x_n, pvs);
+  for (j = 0; j < num_scenarios; j++) {
+    if (ABS(f_n_minus_1[j]) <= opts->res) {  // the guess is already a root: finish there, as _solve() does
+      x_n[j] = x_n_minus_1[j];
+      f_n[j] = f_n_minus_1[j];
+    } else
+      f_n[j] = target_px - pvs[j];
+  }
+
+  opts->iterations = 0;
+  while (active > 0) {
+    if (opts->interrupted != NULL && *opts->interrupted) {
+      free(x_n_minus_1); free(trials);
+      return CH_INTERRUPTED;
+    }
+
+    for (j = 0; j < num_scenarios; j++) {
+      if (trials[j] < 0)
+        continue;
+      if (!isfinite(f_n[j]) || !isfinite(f_n_minus_1[j])) {  // as in _solve(), NaN would otherwise pass for converged
+        results[j] = CH_FAILED_TO_CONVERGE;
+        trials[j] = -1;
+        active--;
+      } else if (!(ABS(f_n[j]) > opts->res && trials[j] < opts->max_tries)) {
+        results[j] = trials[j] >= opts->max_tries ? CH_FAILED_TO_CONVERGE : x_n[j];
+        trials[j] = -1;
+        active--;
+      } else if (f_n[j] == f_n_minus_1[j]) {
+        results[j] = CH_NO_SENSITIVITY;
+        trials[j] = -1;
+        active--;
+      } else {
+        x_n_plus_1     = x_n[j] - f_n[j] * (x_n[j] - x_n_minus_1[j]) / (f_n[j] - f_n_minus_1[j]);
+        x_n_minus_1[j] = x_n[j];
+        x_n[j]         = x_n_plus_1;
+        f_n_minus_1[j] = f_n[j];
+        trials[j]++;
+      }
+    }
+    if (active == 0)
+      break;
+
+    _compute_pv_scenarios(cfs, dates, libor, shifts, num_cfs, num_scenarios, is_clean, accrued_interest, year_convention, x_n, pvs);
+    for (j = 0; j < num_scenarios; j++)
+      if (trials[j] >= 0)
+        f_n[j] = target_px - pvs[j];
+    opts->iterations++;
+  }
+
+  free(x_n_minus_1);
+  free(trials);
+  return 0.0;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include <string.h>
+#include <time.h>
+#include <ruby.h>
+#include "c_helper.h"
+
+/* stats.c
+ * CHelper.stats and CHelper.reset_stats, process-wide counters of how hard the solvers are working; each solve job
+ * tallies into its own solver_stats while it runs without the GVL (see _count_solve()), and _record_stats() adds that
+ * to the totals here once the GVL is back, so the counters cost no locking
+ */
+
+
+
+static solver_stats totals;
+
+
+/* _clock_ns()
+ * internal function that reads the monotonic clock, in nanoseconds
+ */
+long _clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+/* _record_stats()
+ * internal function that adds a finished job's counters to the totals, along with its timings: started_ns is when the
+ * exported function was entered, so everything up to solve_started_ns is getting the inputs out of Ruby
+ *
+ * assumes that the GVL is held
+ */
+void _record_stats(solver_stats *stats, long started_ns, long solve_started_ns, long solve_finished_ns) {
+  long i;
+
+  totals.solves             += stats->solves;
+  totals.pv_evaluations     += stats->pv_evaluations;
+  totals.failed_to_converge += stats->failed_to_converge;
+  totals.no_sensitivity     += stats->no_sensitivity;
+  totals.other_failures     += stats->other_failures;
+  for (i = 0; i < CH_ITERATION_BUCKETS; i++)
+    totals.iterations[i] += stats->iterations[i];
+  if (stats->max_iterations > totals.max_iterations)
+    totals.max_iterations = stats->max_iterations;
+
+  totals.marshal_ns += solve_started_ns - started_ns;
+  totals.solve_ns   += solve_finished_ns - solve_started_ns;
+}
+
+
+/* stats
+ * exported function that returns the counters as a Hash:
+ *  - solves, pv_evaluations: every solve attempted, and every evaluation of the objective (the PV, or the PV and its
+ *    derivative) they made between them
+ *  - iterations: a histogram; iterations[n] solves took n iterations, and the last entry counts everything beyond
+ *  - max_iterations: the most any one solve took
+ *  - failed_to_converge (-998), no_sensitivity (-999), other_failures (no bracket, out of memory)
+ *  - marshal_ns, solve_ns: time spent getting the inputs out of Ruby, and time spent solving without the GVL
+ */
+VALUE stats(VALUE _self) {
+  VALUE hash = rb_hash_new();
+  VALUE iterations = rb_ary_new_capa(CH_ITERATION_BUCKETS);
+  long i;
+
+  for (i = 0; i < CH_ITERATION_BUCKETS; i++)
+    rb_ary_push(iterations, LONG2NUM(totals.iterations[i]));
+
+  rb_hash_aset(hash, ID2SYM(rb_intern("solves")),             LONG2NUM(totals.solves));
+  rb_hash_aset(hash, ID2SYM(rb_intern("pv_evaluations")),     LONG2NUM(totals.pv_evaluations));
+  rb_hash_aset(hash, ID2SYM(rb_intern("iterations")),         iterations);
+  rb_hash_aset(hash, ID2SYM(rb_intern("max_iterations")),     LONG2NUM(totals.max_iterations));
+  rb_hash_aset(hash, ID2SYM(rb_intern("failed_to_converge")), LONG2NUM(totals.failed_to_converge));
+  rb_hash_aset(hash, ID2SYM(rb_intern("no_sensitivity")),     LONG2NUM(totals.no_sensitivity));
+  rb_hash_aset(hash, ID2SYM(rb_intern("other_failures")),     LONG2NUM(totals.other_failures));
+  rb_hash_aset(hash, ID2SYM(rb_intern("marshal_ns")),         LONG2NUM(totals.marshal_ns));
+  rb_hash_aset(hash, ID2SYM(rb_intern("solve_ns")),           LONG2NUM(totals.solve_ns));
+
+  return hash;
+}
+
+
+/* reset_stats
+ * exported function that zeroes every counter
+ */
+VALUE reset_stats(VALUE _self) {
+  memset(&totals, 0, sizeof(totals));
+  return Qnil;
+}
+
+
+void Init_stats(VALUE mod) {
+  rb_define_module_function(mod, "stats", stats, 0);
+  rb_define_module_function(mod, "reset_stats", reset_stats, 0);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+require 'minitest/autorun'
+require 'c_helper'
+
+# regressions in the root-finding behind backsolve_cf and backsolve_irr; run with rake test
+class TestSolver < Minitest::Test
+  # -100 now and 1 in a year is an IRR of -99%; the secant overshoots below -100%, where (1 + irr)^yf isn't real, and
+  # the NaN that comes back used to pass for convergence
+  def test_irr_near_minus_100_percent
+    irr = CHelper.backsolve_irr([-100.0, 1.0], [0.0, 365.0], 2, 1e-8, 100, false, 0.0)
+    assert_in_delta(-0.99, irr, 1e-9)
+  end
+
+  # Newton's first step from 6% lands further below -100% still
+  def test_newton_irr_near_minus_100_percent
+    irr = CHelper.backsolve_irr([-100.0, 1.0], [0.0, 365.0], 2, 1e-8, 100, false, 0.0, method: :newton)
+    assert_in_delta(-0.99, irr, 1e-9)
+  end
+end